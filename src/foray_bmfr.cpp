@@ -1,5 +1,7 @@
 #include "foray_bmfr.hpp"
 #include <bench/foray_devicebenchmark.hpp>
+#include <algorithm>
+#include <cstring>
 #include <imgui/imgui.h>
 
 namespace foray::bmfr {
@@ -54,21 +56,21 @@ namespace foray::bmfr {
                 mFilterImage.Create(mContext, ci);
             }
         }
+        {  // Foveation map placeholder, bound while no map is configured
+            core::ManagedImage::CreateInfo ci(VkImageUsageFlagBits::VK_IMAGE_USAGE_STORAGE_BIT, VkFormat::VK_FORMAT_R8_UNORM, VkExtent2D{1, 1},
+                                              "Bmfr.FoveationPlaceholder");
+            mFoveationPlaceholder.Create(mContext, ci);
+        }
         {  // Setup regression
             glm::uvec2 dispatch      = CalculateDispatchSize(size);
             mRegression.DispatchSize = dispatch;
-            VkExtent2D regressionImageSize{BLOCK_EDGE * BLOCK_EDGE, dispatch.x * dispatch.y * 13};
-            {  // TempData
-                core::ManagedImage::CreateInfo ci(VkImageUsageFlagBits::VK_IMAGE_USAGE_STORAGE_BIT, VkFormat::VK_FORMAT_R16_SFLOAT, regressionImageSize,
-                                                  "Bmfr.Regression.TempData");
-                mRegression.TempData.Create(mContext, ci);
-            }
-            {  // OutData
-                core::ManagedImage::CreateInfo ci(VkImageUsageFlagBits::VK_IMAGE_USAGE_STORAGE_BIT, VkFormat::VK_FORMAT_R16_SFLOAT, regressionImageSize, "Bmfr.Regression.OutData");
-                mRegression.OutData.Create(mContext, ci);
-            }
+            UpdateRegressionImages(dispatch);
         }
 
+        mAutotuner.Init(mContext, mTuningCachePath);
+        mAutotuner.LoadCached(mTuning, mFeatureSet);
+        ValidateFeatureSet();
+
         mPreProcessStage.Init(this);
         mRegressionStage.Init(this);
         mPostProcessStage.Init(this);
@@ -85,12 +87,182 @@ namespace foray::bmfr {
         mInitialized = true;
     }
 
+    void BmfrDenoiser::Init(core::Context* context, ExternalMemoryInterop& interop, bench::DeviceBenchmark* benchmark)
+    {
+        Assert(interop.Exists(), "External memory interop must be created before initializing the denoiser from it");
+        using EImage = ExternalMemoryInterop::EImage;
+
+        stages::DenoiserConfig config;
+        config.PrimaryInput                                                    = interop.GetImage(EImage::Primary);
+        config.PrimaryOutput                                                   = interop.GetImage(EImage::Output);
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Position] = interop.GetImage(EImage::Position);
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Normal]   = interop.GetImage(EImage::Normal);
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Albedo]   = interop.GetImage(EImage::Albedo);
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Motion]   = interop.GetImage(EImage::Motion);
+        config.Benchmark                                                       = benchmark;
+        Init(context, config);
+        mInterop = &interop;
+    }
+
+    void BmfrDenoiser::Init(core::Context* context, CaptureReplayer& replayer, bench::DeviceBenchmark* benchmark)
+    {
+        Assert(replayer.Exists(), "Capture replayer must be opened before initializing the denoiser from it");
+        using EImage                      = capture::EImage;
+        const capture::FileHeader& header = replayer.GetHeader();
+
+        mFeatureSet = FeatureSet{.Features = header.Features, .BlockEdge = header.BlockEdge};
+        Assert(header.Precision == SCRATCH_FP16 || header.Precision == SCRATCH_FP32 || header.Precision == SCRATCH_FP16X2, "Bmfr capture precision is invalid");
+        mRegression.Precision = header.Precision;
+
+        stages::DenoiserConfig config;
+        config.PrimaryInput                                                    = replayer.GetImage(EImage::Primary);
+        config.PrimaryOutput                                                   = replayer.GetOutput();
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Position] = replayer.GetImage(EImage::Position);
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Normal]   = replayer.GetImage(EImage::Normal);
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Albedo]   = replayer.GetImage(EImage::Albedo);
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Motion]   = replayer.GetImage(EImage::Motion);
+        config.Benchmark                                                       = benchmark;
+        Init(context, config);
+
+        // Replays run the shader variants the capture was taken with, not the ones tuned for this device
+        mTuning.PreProcessLocalSize  = glm::uvec2(header.PreProcessLocalSize[0], header.PreProcessLocalSize[1]);
+        mTuning.RegressionLocalSize  = header.RegressionLocalSize;
+        mTuning.PostProcessLocalSize = glm::uvec2(header.PostProcessLocalSize[0], header.PostProcessLocalSize[1]);
+        ValidateFeatureSet();
+        RebuildPipelines();
+    }
+
     glm::uvec2 BmfrDenoiser::CalculateDispatchSize(const VkExtent2D& renderSize)
     {
-        glm::uvec2 size((renderSize.width + BLOCK_EDGE - 1) / BLOCK_EDGE, (renderSize.height + BLOCK_EDGE - 1) / BLOCK_EDGE);
+        uint32_t   blockEdge = mFeatureSet.BlockEdge;
+        glm::uvec2 size((renderSize.width + blockEdge - 1) / blockEdge, (renderSize.height + blockEdge - 1) / blockEdge);
         return size + glm::uvec2(1);
     }
 
+    void BmfrDenoiser::UpdateRegressionImages(const glm::uvec2& dispatchSize)
+    {
+        // One row per buffer and block, packed precision stores two buffers per row
+        uint32_t   rowsPerBlock = mFeatureSet.GetBufferCount();
+        VkExtent2D placeholder{1, 1};
+        VkExtent2D size16 = placeholder;
+        VkExtent2D size32 = placeholder;
+        if(mRegression.Precision == SCRATCH_FP16)
+        {
+            size16 = VkExtent2D{mFeatureSet.GetBlockSize(), dispatchSize.x * dispatchSize.y * rowsPerBlock};
+        }
+        else
+        {
+            if(mRegression.Precision == SCRATCH_FP16X2)
+            {
+                rowsPerBlock = (rowsPerBlock + 1) / 2;
+            }
+            size32 = VkExtent2D{mFeatureSet.GetBlockSize(), dispatchSize.x * dispatchSize.y * rowsPerBlock};
+        }
+
+        struct
+        {
+            core::ManagedImage* Image;
+            VkFormat            Format;
+            VkExtent2D          Size;
+            const char*         Name;
+        } images[] = {
+            {&mRegression.TempData, VkFormat::VK_FORMAT_R16_SFLOAT, size16, "Bmfr.Regression.TempData"},
+            {&mRegression.OutData, VkFormat::VK_FORMAT_R16_SFLOAT, size16, "Bmfr.Regression.OutData"},
+            {&mRegression.TempData32, VkFormat::VK_FORMAT_R32_UINT, size32, "Bmfr.Regression.TempData32"},
+            {&mRegression.OutData32, VkFormat::VK_FORMAT_R32_UINT, size32, "Bmfr.Regression.OutData32"},
+        };
+        for(auto& image : images)
+        {
+            if(image.Image->Exists())
+            {
+                image.Image->Resize(image.Size);
+            }
+            else
+            {
+                core::ManagedImage::CreateInfo ci(VkImageUsageFlagBits::VK_IMAGE_USAGE_STORAGE_BIT, image.Format, image.Size, image.Name);
+                image.Image->Create(mContext, ci);
+            }
+        }
+    }
+
+    uint32_t BmfrDenoiser::GetMinRegressionLocalSize() const
+    {
+        // Building the R matrix needs 3 invocations per feature, the parallel reduction at least 32.
+        // Each invocation keeps a filtered color per pixel of its subvector in registers (regression.comp), which spill beyond MAX_SUBVECTOR_SIZE
+        const uint32_t MAX_SUBVECTOR_SIZE = 16;
+        uint32_t       minLocalSize       = 32;
+        while(minLocalSize < 3 * mFeatureSet.GetFeatureCount() || minLocalSize * MAX_SUBVECTOR_SIZE < mFeatureSet.GetBlockSize())
+        {
+            minLocalSize *= 2;
+        }
+        return minLocalSize;
+    }
+
+    void BmfrDenoiser::ValidateFeatureSet()
+    {
+        uint32_t blockEdge = mFeatureSet.BlockEdge;
+        Assert(blockEdge >= 16 && blockEdge <= 64 && (blockEdge & (blockEdge - 1)) == 0, "Bmfr block edge must be 16, 32 or 64");
+        Assert(GetMinRegressionLocalSize() <= mFeatureSet.GetBlockSize(), "Bmfr block is too small for the feature set");
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(mContext->PhysicalDevice(), &properties);
+        Assert(GetMinRegressionLocalSize() <= properties.limits.maxComputeWorkGroupInvocations && GetMinRegressionLocalSize() <= properties.limits.maxComputeWorkGroupSize[0],
+               "Bmfr block size needs a larger regression workgroup than the device supports");
+
+        mTuning.RegressionLocalSize = std::clamp(mTuning.RegressionLocalSize, GetMinRegressionLocalSize(), mFeatureSet.GetBlockSize());
+        // Shared_T in regression.comp
+        size_t sharedMemorySize = sizeof(fp32_t)
+                                  * (mTuning.RegressionLocalSize + mFeatureSet.GetBlockSize() + mFeatureSet.GetFeatureCount() * mFeatureSet.GetBufferCount() + 5);
+        Assert(sharedMemorySize <= properties.limits.maxComputeSharedMemorySize, "Bmfr feature set exceeds the shared memory limit of the device");
+
+        // History tile in preprocess.comp (local size + 1 + HISTORY_TILE_SLACK per axis): fp32 positions and normals, half packed color, tile bounds
+        glm::uvec2 tileExtent      = mTuning.PreProcessLocalSize + glm::uvec2(3);
+        size_t     historyTileSize = (size_t)tileExtent.x * tileExtent.y * (sizeof(glm::vec4) * 2 + sizeof(glm::uvec2)) + sizeof(glm::ivec4);
+        Assert(historyTileSize <= properties.limits.maxComputeSharedMemorySize, "Bmfr preprocess workgroup exceeds the shared memory limit of the device");
+    }
+
+    void BmfrDenoiser::SetFeatureSet(const FeatureSet& featureSet)
+    {
+        if(featureSet == mFeatureSet)
+        {
+            return;
+        }
+        mFeatureSet = featureSet;
+        if(!mInitialized)
+        {
+            return;
+        }
+        // The capture header describes a single feature set
+        StopCapture();
+
+        // Tuned regression workgroup sizes are only valid for the feature set they were measured with
+        mAutotuner.LoadCached(mTuning, mFeatureSet);
+        ValidateFeatureSet();
+        RebuildPipelines();
+
+        glm::uvec2 dispatch      = CalculateDispatchSize(mFilterImage.GetExtent2D());
+        mRegression.DispatchSize = dispatch;
+        UpdateRegressionImages(dispatch);
+        mRegressionStage.UpdateDescriptorSet();
+    }
+
+    void BmfrDenoiser::SetRegressionPrecision(uint32_t precision)
+    {
+        Assert(precision == SCRATCH_FP16 || precision == SCRATCH_FP32 || precision == SCRATCH_FP16X2, "Bmfr regression precision must be one of SCRATCH_*");
+        if(precision == mRegression.Precision)
+        {
+            return;
+        }
+        mRegression.Precision = precision;
+        if(!mInitialized)
+        {
+            return;
+        }
+        RebuildPipelines();
+        UpdateRegressionImages(mRegression.DispatchSize);
+        mRegressionStage.UpdateDescriptorSet();
+    }
+
     std::string BmfrDenoiser::GetUILabel()
     {
         return "BMFR Denoiser";
@@ -100,12 +272,110 @@ namespace foray::bmfr {
         const char* debugModes[] = {
             "DEBUG_NONE",           "DEBUG_PREPROCESS_OUT",    "DEBUG_PREPROCESS_ACCEPTS",  "DEBUG_PREPROCESS_ALPHA",
             "DEBUG_REGRESSION_OUT", "DEBUG_REGRESSION_BLOCKS", "DEBUG_POSTPROCESS_ACCEPTS", "DEBUG_POSTPROCESS_ALPHA",
+            "DEBUG_FOVEATION_QUALITY", "DEBUG_REGRESSION_DEGENERATE",
         };
         int debugMode = (int)mDebugMode;
         if(ImGui::Combo("Debug Mode", &debugMode, debugModes, sizeof(debugModes) / sizeof(const char*)))
         {
             mDebugMode = (uint32_t)debugMode;
         }
+        if(ImGui::CollapsingHeader("Workgroup Tuning"))
+        {
+            ImGui::Text("PreProcess %ux%u, Regression %u, PostProcess %ux%u", mTuning.PreProcessLocalSize.x, mTuning.PreProcessLocalSize.y, mTuning.RegressionLocalSize,
+                        mTuning.PostProcessLocalSize.x, mTuning.PostProcessLocalSize.y);
+            bool historyTileCache = mHistoryTileCache;
+            if(ImGui::Checkbox("History Tile Cache", &historyTileCache))
+            {
+                SetHistoryTileCache(historyTileCache);
+            }
+            if(ImGui::IsItemHovered())
+                ImGui::SetTooltip("Pre- and PostProcess gather reprojected history from shared memory");
+            if(mAutotuner.IsRunning())
+            {
+                ImGui::Text("Autotuning ...");
+            }
+            else if(ImGui::Button("Autotune"))
+            {
+                StartAutotuning();
+            }
+        }
+        if(ImGui::CollapsingHeader("Regression Features"))
+        {
+            const char* featureSets[] = {"Default (10 features)", "Cheap (7 features)", "Extended (13 features)"};
+            FeatureSet  presets[]     = {FeatureSet::Default(), FeatureSet::Cheap(), FeatureSet::Extended()};
+            int         featureSetIdx = 0;
+            for(int i = 0; i < 3; i++)
+            {
+                if(presets[i].Features == mFeatureSet.Features)
+                {
+                    featureSetIdx = i;
+                }
+            }
+            const char* blockEdges[] = {"16x16", "32x32", "64x64"};
+            int         blockEdgeIdx = mFeatureSet.BlockEdge == 16 ? 0 : (mFeatureSet.BlockEdge == 64 ? 2 : 1);
+            bool        changed      = ImGui::Combo("Feature Set", &featureSetIdx, featureSets, sizeof(featureSets) / sizeof(const char*));
+            changed                  = ImGui::Combo("Block Size", &blockEdgeIdx, blockEdges, sizeof(blockEdges) / sizeof(const char*)) || changed;
+            if(changed)
+            {
+                FeatureSet featureSet = presets[featureSetIdx];
+                featureSet.BlockEdge  = 16U << blockEdgeIdx;
+                SetFeatureSet(featureSet);
+            }
+            const char* precisions[] = {"fp16", "fp32", "fp16x2 (packed)"};
+            int         precision    = (int)mRegression.Precision;
+            if(ImGui::Combo("Scratch Precision", &precision, precisions, sizeof(precisions) / sizeof(const char*)))
+            {
+                SetRegressionPrecision((uint32_t)precision);
+            }
+            if(ImGui::IsItemHovered())
+                ImGui::SetTooltip("Storage of per pixel features between regression steps. Reductions are fp32 regardless");
+        }
+        if(ImGui::CollapsingHeader("Foveation"))
+        {
+            FoveationConfig foveation = mFoveation;
+            const char*     modes[]   = {"Off", "Gaze", "Map"};
+            int             mode      = (int)foveation.Mode;
+            int             modeCount = !!foveation.Map ? 3 : 2;
+            bool            changed   = ImGui::Combo("Foveation Mode", &mode, modes, modeCount);
+            foveation.Mode            = (uint32_t)mode;
+            if(foveation.Mode == FOVEATION_GAZE)
+            {
+                changed = ImGui::SliderFloat2("Gaze", &foveation.Gaze.x, 0.f, 1.f) || changed;
+                changed = ImGui::SliderFloat("Inner Radius", &foveation.InnerRadius, 0.f, foveation.OuterRadius) || changed;
+                changed = ImGui::SliderFloat("Outer Radius", &foveation.OuterRadius, foveation.InnerRadius, 2.f) || changed;
+            }
+            if(changed)
+            {
+                SetFoveation(foveation);
+            }
+        }
+        if(ImGui::CollapsingHeader("Capture"))
+        {
+            if(IsCapturing())
+            {
+                ImGui::Text("Capturing to %s (%u frames dropped)", CAPTURE_PATH, mCapture.GetDroppedFrameCount());
+                if(ImGui::Button("Stop Capture"))
+                {
+                    StopCapture();
+                }
+            }
+            else if(mCapture.IsOpen())
+            {
+                ImGui::Text("Finishing %s", CAPTURE_PATH);
+            }
+            else if(!mHostSignalsCapture)
+            {  // Readbacks would never complete
+                ImGui::TextWrapped("Capturing needs the host to signal GetCaptureSignalInfo() in its submit (SetHostSignalsCapture)");
+            }
+            else
+            {
+                ImGui::Checkbox("Store fp32 inputs as fp16 (lossy)", &mCaptureOptions.CompressFp16);
+                if(ImGui::Button("Start Capture"))
+                {
+                    StartCapture(CAPTURE_PATH, mCaptureOptions);
+                }
+            }
+        }
         if(ImGui::CollapsingHeader("PreProcess"))
         {
             float maxNormalDiffDegrees = glm::degrees(glm::asin(mPreProcessStage.mPushC.MaxNormalDeviation));
@@ -164,8 +434,164 @@ namespace foray::bmfr {
         mHistory.Valid = false;
     }
 
+    void BmfrDenoiser::SetFoveation(const FoveationConfig& foveation)
+    {
+        Assert(foveation.Mode != FOVEATION_MAP || !!foveation.Map, "Bmfr foveation mode FOVEATION_MAP requires a foveation map");
+        Assert(!foveation.Map || foveation.Map->GetFormat() == VkFormat::VK_FORMAT_R8_UNORM, "Bmfr foveation map must be VK_FORMAT_R8_UNORM");
+        Assert(foveation.InnerRadius <= foveation.OuterRadius, "Bmfr foveation inner radius must not exceed outer radius");
+
+        bool mapChanged = foveation.Map != mFoveation.Map;
+        mFoveation      = foveation;
+        if(mapChanged && mInitialized)
+        {
+            // Descriptor sets may still be in use by previous frames
+            AssertVkResult(vkDeviceWaitIdle(mContext->Device()));
+            mRegressionStage.UpdateDescriptorSet();
+            mPostProcessStage.UpdateDescriptorSet();
+        }
+    }
+
+    core::ManagedImage* BmfrDenoiser::GetFoveationMap()
+    {
+        return !!mFoveation.Map ? mFoveation.Map : &mFoveationPlaceholder;
+    }
+
+    FoveationPushConstant BmfrDenoiser::GetFoveationPushConstant() const
+    {
+        return FoveationPushConstant{.Gaze = mFoveation.Gaze, .InnerRadius = mFoveation.InnerRadius, .OuterRadius = mFoveation.OuterRadius, .Mode = mFoveation.Mode};
+    }
+
+    void BmfrDenoiser::StartCapture(const std::string& path, const CaptureWriter::Options& options)
+    {
+        Assert(mInitialized, "Bmfr denoiser must be initialized before capturing");
+        Assert(mHostSignalsCapture, "Bmfr capture needs the host to submit GetCaptureSignalInfo() every frame, see SetHostSignalsCapture");
+        capture::FileHeader header;
+        header.OutputFormat            = mPrimaryOutput->GetFormat();
+        header.Features                = mFeatureSet.Features;
+        header.BlockEdge               = mFeatureSet.BlockEdge;
+        header.PreProcessLocalSize[0]  = mTuning.PreProcessLocalSize.x;
+        header.PreProcessLocalSize[1]  = mTuning.PreProcessLocalSize.y;
+        header.RegressionLocalSize     = mTuning.RegressionLocalSize;
+        header.PostProcessLocalSize[0] = mTuning.PostProcessLocalSize.x;
+        header.PostProcessLocalSize[1] = mTuning.PostProcessLocalSize.y;
+        header.Precision               = mRegression.Precision;
+
+        core::ManagedImage* const images[(size_t)capture::EImage::MaxEnum] = {mInputs.Primary, mInputs.Position, mInputs.Normal, mInputs.Albedo, mInputs.Motion};
+        mCapture.Open(mContext, path, options, header, images);
+    }
+
+    void BmfrDenoiser::StopCapture()
+    {
+        // Copies recorded this frame are still written, once the submit signalled them
+        mCapture.Stop();
+    }
+
+    void BmfrDenoiser::CaptureFrame(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo, bool historyValid)
+    {
+        capture::FrameState frame;
+        frame.Header.FrameNumber  = renderInfo.GetFrameNumber();
+        frame.Header.HistoryValid = historyValid;
+        frame.Header.DebugMode    = mDebugMode;
+
+        auto storePushC = [&frame](capture::EStage stage, const auto& pushC) {
+            const uint8_t* bytes = (const uint8_t*)&pushC;
+            frame.PushConstants[(size_t)stage].assign(bytes, bytes + sizeof(pushC));
+        };
+        storePushC(capture::EStage::PreProcess, mPreProcessStage.mPushC);
+        storePushC(capture::EStage::Regression, mRegressionStage.mPushC);
+        storePushC(capture::EStage::PostProcess, mPostProcessStage.mPushC);
+
+        mCapture.CmdCapture(cmdBuffer, renderInfo, std::move(frame));
+    }
+
+    void BmfrDenoiser::ApplyCapturedFrame(const capture::FrameState& frame)
+    {
+        auto loadPushC = [&frame](capture::EStage stage, auto& pushC) {
+            const std::vector<uint8_t>& bytes = frame.PushConstants[(size_t)stage];
+            Assert(bytes.size() == sizeof(pushC), "Bmfr capture push constants do not match this build");
+            std::memcpy(&pushC, bytes.data(), sizeof(pushC));
+        };
+        loadPushC(capture::EStage::PreProcess, mPreProcessStage.mPushC);
+        loadPushC(capture::EStage::Regression, mRegressionStage.mPushC);
+        loadPushC(capture::EStage::PostProcess, mPostProcessStage.mPushC);
+
+        // Frame dependent push constant fields are derived again while recording, from the state restored here
+        mDebugMode = frame.Header.DebugMode;
+        if(!frame.Header.HistoryValid)
+        {
+            IgnoreHistoryNextFrame();
+        }
+        else if(frame.Header.DroppedBefore != 0)
+        {  // History of the dropped frames is not in the capture, and the read/write history layers alternate with the frame number
+            logger()->warn("Bmfr replay: {} frames before frame {} were not captured, history is reset", frame.Header.DroppedBefore, frame.Header.FrameNumber);
+            IgnoreHistoryNextFrame();
+        }
+
+        // Foveation maps are not part of captures. Map driven foveation replays unfoveated
+        const FoveationPushConstant& foveation = mRegressionStage.mPushC.Foveation;
+        mFoveation.Mode                        = foveation.Mode == FOVEATION_MAP ? FOVEATION_OFF : foveation.Mode;
+        mFoveation.Gaze                        = foveation.Gaze;
+        mFoveation.InnerRadius                 = foveation.InnerRadius;
+        mFoveation.OuterRadius                 = foveation.OuterRadius;
+    }
+
+    void BmfrDenoiser::RecordReplayFrame(VkCommandBuffer cmdBuffer, CaptureReplayer& replayer, uint32_t index)
+    {
+        base::FrameRenderInfo      renderInfo;
+        const capture::FrameState& frame = replayer.CmdUploadFrame(cmdBuffer, index, renderInfo);
+        renderInfo.SetFrameNumber(frame.Header.FrameNumber);
+        renderInfo.SetRenderSize(mInputs.Primary->GetExtent2D());
+        ApplyCapturedFrame(frame);
+        RecordFrame(cmdBuffer, renderInfo);
+    }
+
+    void BmfrDenoiser::StartAutotuning()
+    {
+        mAutotuner.Start(mFeatureSet, GetMinRegressionLocalSize());
+    }
+
+    void BmfrDenoiser::SetHistoryTileCache(bool enable)
+    {
+        if(enable == mHistoryTileCache)
+        {
+            return;
+        }
+        mHistoryTileCache = enable;
+        if(mInitialized)
+        {
+            RebuildPipelines();
+        }
+    }
+
+    void BmfrDenoiser::RebuildPipelines()
+    {
+        // Pipelines of previous frames may still be executing
+        AssertVkResult(vkDeviceWaitIdle(mContext->Device()));
+        mPreProcessStage.RebuildPipeline();
+        mRegressionStage.RebuildPipeline();
+        mPostProcessStage.RebuildPipeline();
+    }
+
     void BmfrDenoiser::RecordFrame(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo)
     {
+        // Never waits on the device: only hands completed readbacks to the writer thread
+        mCapture.Update();
+        bool historyValid = mHistory.Valid;
+
+        if(!!mInterop)
+        {
+            mInterop->CmdAcquire(cmdBuffer, renderInfo);
+        }
+        if(!!mFoveation.Map)
+        {  // Updated by the application, the per frame layout cache would otherwise transition it from VK_IMAGE_LAYOUT_UNDEFINED
+            renderInfo.GetImageLayoutCache().Set(*mFoveation.Map, VkImageLayout::VK_IMAGE_LAYOUT_GENERAL);
+        }
+
+        if(mAutotuner.IsRunning() && mAutotuner.BeginFrame(cmdBuffer, renderInfo.GetFrameNumber(), mTuning))
+        {
+            RebuildPipelines();
+        }
+
         if(mHistory.Valid)
         {
             renderInfo.GetImageLayoutCache().Set(mAccuImages.Input, VkImageLayout::VK_IMAGE_LAYOUT_GENERAL);
@@ -182,25 +608,39 @@ namespace foray::bmfr {
             mBenchmark->CmdResetQuery(cmdBuffer, frameIdx);
             mBenchmark->CmdWriteTimestamp(cmdBuffer, frameIdx, bench::BenchmarkTimestamp::BEGIN, compute);
         }
+        mAutotuner.CmdWriteTimestamp(cmdBuffer, frameIdx, Autotuner::EStage::PreProcess, false);
         mPreProcessStage.RecordFrame(cmdBuffer, renderInfo);
+        mAutotuner.CmdWriteTimestamp(cmdBuffer, frameIdx, Autotuner::EStage::PreProcess, true);
         if(!!mBenchmark)
         {
             mBenchmark->CmdWriteTimestamp(cmdBuffer, frameIdx, TIMESTAMP_PreProcess, compute);
         }
+        mAutotuner.CmdWriteTimestamp(cmdBuffer, frameIdx, Autotuner::EStage::Regression, false);
         mRegressionStage.RecordFrame(cmdBuffer, renderInfo);
+        mAutotuner.CmdWriteTimestamp(cmdBuffer, frameIdx, Autotuner::EStage::Regression, true);
         if(!!mBenchmark)
         {
             mBenchmark->CmdWriteTimestamp(cmdBuffer, frameIdx, TIMESTAMP_Regression, compute);
         }
+        mAutotuner.CmdWriteTimestamp(cmdBuffer, frameIdx, Autotuner::EStage::PostProcess, false);
         mPostProcessStage.RecordFrame(cmdBuffer, renderInfo);
+        mAutotuner.CmdWriteTimestamp(cmdBuffer, frameIdx, Autotuner::EStage::PostProcess, true);
         if(!!mBenchmark)
         {
             mBenchmark->CmdWriteTimestamp(cmdBuffer, frameIdx, TIMESTAMP_PostProcess, VkPipelineStageFlagBits::VK_PIPELINE_STAGE_TRANSFER_BIT);
         }
+        if(IsCapturing())
+        {
+            CaptureFrame(cmdBuffer, renderInfo, historyValid);
+        }
 
         std::vector<util::HistoryImage*> historyImages({&mHistory.Position, &mHistory.Normal});
         util::HistoryImage::sMultiCopySourceToHistory(historyImages, cmdBuffer, renderInfo);
         mHistory.Valid = true;
+        if(!!mInterop)
+        {  // After the history copies, which read the position and normal inputs
+            mInterop->CmdRelease(cmdBuffer, renderInfo);
+        }
         if(!!mBenchmark)
         {
             mBenchmark->CmdWriteTimestamp(cmdBuffer, frameIdx, bench::BenchmarkTimestamp::END, VkPipelineStageFlagBits::VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
@@ -218,6 +658,15 @@ namespace foray::bmfr {
         {
             return;
         }
+        // The capture header describes a single extent
+        StopCapture();
+
+        // Images below may still be used by frames in flight
+        AssertVkResult(vkDeviceWaitIdle(mContext->Device()));
+        if(!!mInterop && (mInterop->GetExtent().width != size.width || mInterop->GetExtent().height != size.height))
+        {  // Inputs and output are the interop images, which are recreated in place before the descriptor sets are updated
+            mInterop->Resize(size);
+        }
 
         std::vector<core::ManagedImage*> images({&mAccuImages.Input, &mAccuImages.Filtered, &mAccuImages.AcceptBools, &mFilterImage});
         for(core::ManagedImage* image : images)
@@ -233,9 +682,7 @@ namespace foray::bmfr {
         {  // Setup regression
             glm::uvec2 dispatch      = CalculateDispatchSize(size);
             mRegression.DispatchSize = dispatch;
-            VkExtent2D regressionImageSize{BLOCK_EDGE * BLOCK_EDGE, dispatch.x * dispatch.y * 13};
-            mRegression.TempData.Resize(regressionImageSize);
-            mRegression.OutData.Resize(regressionImageSize);
+            UpdateRegressionImages(dispatch);
         }
 
 
@@ -247,11 +694,16 @@ namespace foray::bmfr {
     void BmfrDenoiser::Destroy()
     {
         mInitialized = false;
+        mInterop     = nullptr;
 
+        mCapture.Close();
         mPostProcessStage.Destroy();
         mRegressionStage.Destroy();
         mPreProcessStage.Destroy();
-        std::vector<core::ManagedImage*> images({&mAccuImages.Input, &mAccuImages.Filtered, &mAccuImages.AcceptBools, &mFilterImage, &mRegression.TempData, &mRegression.OutData});
+        mAutotuner.Destroy();
+        std::vector<core::ManagedImage*> images(
+            {&mAccuImages.Input, &mAccuImages.Filtered, &mAccuImages.AcceptBools, &mFilterImage, &mRegression.TempData, &mRegression.OutData,
+             &mRegression.TempData32, &mRegression.OutData32, &mFoveationPlaceholder});
         for(core::ManagedImage* image : images)
         {
             image->Destroy();
@@ -1,11 +1,17 @@
 #pragma once
+#include "foray_bmfr_capture.hpp"
+#include "foray_bmfr_externalmemory.hpp"
+#include "foray_bmfr_featureset.hpp"
+#include "foray_bmfr_foveation.hpp"
 #include "foray_bmfr_postprocessstage.hpp"
 #include "foray_bmfr_preprocessstage.hpp"
 #include "foray_bmfr_regressionstage.hpp"
+#include "foray_bmfr_tuning.hpp"
 #include <core/foray_managedimage.hpp>
 #include <stages/foray_denoiserstage.hpp>
 #include <util/foray_historyimage.hpp>
 #include "shaders/debug.glsl.h"
+#include "shaders/precision.glsl.h"
 
 namespace foray::bmfr {
     class PreProcessStage;
@@ -19,9 +25,13 @@ namespace foray::bmfr {
         friend PostProcessStage;
 
       public:
-        inline static const uint32_t BLOCK_EDGE = 32;
+        [[deprecated("Block edge is configurable, use GetFeatureSet().BlockEdge")]] inline static const uint32_t BLOCK_EDGE = FeatureSet::DEFAULT_BLOCK_EDGE;
 
         virtual void        Init(core::Context* context, const stages::DenoiserConfig& config) override;
+        /// @brief Binds the images of an external memory interop as inputs and output, so a producer process' buffers are read in place
+        void                Init(core::Context* context, ExternalMemoryInterop& interop, bench::DeviceBenchmark* benchmark = nullptr);
+        /// @brief Binds the images of a capture replayer and applies the feature set, workgroup shapes and scratch precision the capture was taken with
+        void                Init(core::Context* context, CaptureReplayer& replayer, bench::DeviceBenchmark* benchmark = nullptr);
         virtual void        RecordFrame(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo) override;
         virtual std::string GetUILabel() override;
         virtual void        DisplayImguiConfiguration() override;
@@ -29,12 +39,69 @@ namespace foray::bmfr {
         virtual void        OnShadersRecompiled(const std::unordered_set<uint64_t>& recompiled) override;
 
 
+        /// @brief Waits for the device to idle. Also resizes the ExternalMemoryInterop the denoiser was initialized from, if any
         virtual void Resize(const VkExtent2D& size) override;
 
         virtual void Destroy() override;
 
+        /// @brief Starts benchmarking workgroup shapes on the following frames. The result is persisted to the tuning cache path
+        void StartAutotuning();
+        inline const TuningConfig& GetTuningConfig() const { return mTuning; }
+        /// @brief File tuning results are stored in, per device. Defaults to Autotuner::GetDefaultCachePath(). Takes effect on the next Init
+        inline void               SetTuningCachePath(std::string_view path) { mTuningCachePath = path; }
+        inline const std::string& GetTuningCachePath() const { return mTuningCachePath; }
+
+        /// @brief Selects whether the temporal passes gather reprojected history from a shared memory tile (see shaders/historytile.glsl)
+        void SetHistoryTileCache(bool enable);
+        inline bool GetHistoryTileCache() const { return mHistoryTileCache; }
+
+        /// @brief Selects the regression feature set and block size. Recreates regression resources and pipeline if already initialized
+        void SetFeatureSet(const FeatureSet& featureSet);
+        inline const FeatureSet& GetFeatureSet() const { return mFeatureSet; }
+
+        /// @brief Selects the storage precision of the regression scratch images (SCRATCH_FP16, SCRATCH_FP32 or SCRATCH_FP16X2, see shaders/precision.glsl.h)
+        void SetRegressionPrecision(uint32_t precision);
+        inline uint32_t GetRegressionPrecision() const { return mRegression.Precision; }
+
+        /// @brief Configures region weighted quality. Can be updated every frame (e.g. with eye tracking)
+        void SetFoveation(const FoveationConfig& foveation);
+        inline const FoveationConfig& GetFoveation() const { return mFoveation; }
+
+        /// @brief Declares that the host includes GetCaptureSignalInfo() in the submit of every frame. Capturing requires it, the UI offers
+        /// capturing only if set (the standard DenoiserStage integration does not submit the signal)
+        inline void SetHostSignalsCapture(bool signals) { mHostSignalsCapture = signals; }
+        inline bool GetHostSignalsCapture() const { return mHostSignalsCapture; }
+
+        /// @brief Starts writing inputs and state of every following frame to path. Waits for the device if a stopped capture is still being finished.
+        /// Asserts SetHostSignalsCapture(true) was called
+        void StartCapture(const std::string& path, const CaptureWriter::Options& options = CaptureWriter::Options());
+        /// @brief Stops capturing. The file is finished over the following frames, once the copies of all captured frames have completed
+        void StopCapture();
+        inline bool IsCapturing() const { return mCapture.IsOpen() && !mCapture.IsStopping(); }
+        /// @brief While capturing, the submit of the command buffer passed to RecordFrame(...) has to signal this. Semaphore is nullptr if the frame
+        /// was not captured. Call exactly once per submit
+        inline VkSemaphoreSubmitInfo GetCaptureSignalInfo() { return mCapture.GetFrameSignalInfo(); }
+
+        /// @brief Uploads a captured frame and records the denoiser with the captured frame number, push constants and history events
+        /// @details Uses a render info of its own, so frame numbers match the capture. The replayer output is left in VK_IMAGE_LAYOUT_GENERAL.
+        void RecordReplayFrame(VkCommandBuffer cmdBuffer, CaptureReplayer& replayer, uint32_t index);
+
+        inline static const char* CAPTURE_PATH = "bmfr_capture.bin";
+
       protected:
+        void RebuildPipelines();
+
         glm::uvec2 CalculateDispatchSize(const VkExtent2D& renderSize);
+        /// @brief Creates or resizes the regression scratch images for dispatch size and precision. Images of the unused precision shrink to 1x1
+        void       UpdateRegressionImages(const glm::uvec2& dispatchSize);
+        /// @brief Asserts the feature set fits the device and clamps the regression workgroup size to what the feature set allows
+        void       ValidateFeatureSet();
+        uint32_t   GetMinRegressionLocalSize() const;
+        /// @brief Foveation map to bind. Placeholder image if no map is configured
+        core::ManagedImage*   GetFoveationMap();
+        FoveationPushConstant GetFoveationPushConstant() const;
+        void                  CaptureFrame(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo, bool historyValid);
+        void                  ApplyCapturedFrame(const capture::FrameState& frame);
 
         struct
         {
@@ -46,6 +113,8 @@ namespace foray::bmfr {
         } mInputs;
 
         core::ManagedImage* mPrimaryOutput = nullptr;
+        /// @brief Set if inputs and output are bound from an interop, whose images are acquired and released every frame
+        ExternalMemoryInterop* mInterop = nullptr;
 
         struct
         {
@@ -58,6 +127,9 @@ namespace foray::bmfr {
 
         core::ManagedImage mFilterImage;
 
+        FoveationConfig    mFoveation;
+        core::ManagedImage mFoveationPlaceholder;
+
         struct
         {
             util::HistoryImage Position;
@@ -68,11 +140,25 @@ namespace foray::bmfr {
         struct {
             core::ManagedImage TempData;
             core::ManagedImage OutData;
+            // Scratch images for SCRATCH_FP32 and SCRATCH_FP16X2
+            core::ManagedImage TempData32;
+            core::ManagedImage OutData32;
             glm::uvec2 DispatchSize;
+            uint32_t   Precision = SCRATCH_FP16;
         } mRegression;
 
         uint32_t mDebugMode = DEBUG_NONE;
 
+        FeatureSet   mFeatureSet;
+        TuningConfig mTuning;
+        std::string  mTuningCachePath = Autotuner::GetDefaultCachePath();
+        bool         mHistoryTileCache = true;
+        Autotuner    mAutotuner;
+
+        CaptureWriter          mCapture;
+        CaptureWriter::Options mCaptureOptions;
+        bool                   mHostSignalsCapture = false;
+
         PreProcessStage  mPreProcessStage;
         RegressionStage  mRegressionStage;
         PostProcessStage mPostProcessStage;
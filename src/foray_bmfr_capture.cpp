@@ -0,0 +1,548 @@
+#include "foray_bmfr_capture.hpp"
+#include <core/foray_context.hpp>
+#include <glm/gtc/packing.hpp>
+
+namespace foray::bmfr {
+    namespace capture {
+        uint32_t GetTexelSize(VkFormat format)
+        {
+            switch(format)
+            {
+                case VkFormat::VK_FORMAT_R32G32B32A32_SFLOAT:
+                    return 16;
+                case VkFormat::VK_FORMAT_R32G32_SFLOAT:
+                case VkFormat::VK_FORMAT_R16G16B16A16_SFLOAT:
+                    return 8;
+                case VkFormat::VK_FORMAT_R32_SFLOAT:
+                case VkFormat::VK_FORMAT_R16G16_SFLOAT:
+                case VkFormat::VK_FORMAT_R8G8B8A8_UNORM:
+                    return 4;
+                case VkFormat::VK_FORMAT_R16_SFLOAT:
+                    return 2;
+                default:
+                    Assert(false, "Bmfr capture does not support the image format");
+                    return 0;
+            }
+        }
+
+        bool IsFp32Format(VkFormat format)
+        {
+            return format == VkFormat::VK_FORMAT_R32G32B32A32_SFLOAT || format == VkFormat::VK_FORMAT_R32G32_SFLOAT || format == VkFormat::VK_FORMAT_R32_SFLOAT;
+        }
+    }  // namespace capture
+
+    void CaptureWriter::Open(core::Context* context, const std::string& path, const Options& options, capture::FileHeader header,
+                             core::ManagedImage* const (&images)[(size_t)capture::EImage::MaxEnum])
+    {
+        Close();
+        mContext = context;
+        mOptions = options;
+
+        VkExtent2D extent = images[(size_t)capture::EImage::Primary]->GetExtent2D();
+        header.Width      = extent.width;
+        header.Height     = extent.height;
+        mSlotSize         = 0;
+        for(size_t i = 0; i < (size_t)capture::EImage::MaxEnum; i++)
+        {
+            mImages[i]        = images[i];
+            header.Formats[i] = images[i]->GetFormat();
+            Assert(images[i]->GetExtent2D().width == extent.width && images[i]->GetExtent2D().height == extent.height, "Bmfr capture inputs must share one extent");
+            mImageOffsets[i] = mSlotSize;
+            mSlotSize += ((VkDeviceSize)extent.width * extent.height * capture::GetTexelSize(header.Formats[i]) + 15) & ~(VkDeviceSize)15;
+        }
+        mHeader = header;
+
+        mFile.open(path, std::ios::binary | std::ios::trunc);
+        Assert(mFile.is_open(), "Bmfr capture could not open output file");
+        Write(&mHeader, sizeof(mHeader));
+
+        VkSemaphoreTypeCreateInfo timelineCi{.sType = VkStructureType::VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO, .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE};
+        VkSemaphoreCreateInfo     semaphoreCi{.sType = VkStructureType::VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &timelineCi};
+        AssertVkResult(vkCreateSemaphore(mContext->Device(), &semaphoreCi, nullptr, &mTimeline));
+        mTimelineValue = 0;
+        mSignalPending = false;
+
+        mIndex.clear();
+        mDroppedSinceLast = 0;
+        mDroppedTotal     = 0;
+        mStopping         = false;
+        mStopWriter       = false;
+        mWriterDone       = false;
+        mWriter           = std::thread(&CaptureWriter::WriterThread, this);
+    }
+
+    void CaptureWriter::CreateSlot(Slot& slot)
+    {
+        VkBufferCreateInfo      bufferCi{.sType = VkStructureType::VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                         .size  = mSlotSize,
+                                         .usage = VkBufferUsageFlagBits::VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+        VmaAllocationCreateInfo allocCi{.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, .usage = VMA_MEMORY_USAGE_AUTO};
+        VmaAllocationInfo       allocInfo{};
+        AssertVkResult(vmaCreateBuffer(mContext->Allocator, &bufferCi, &allocCi, &slot.Buffer, &slot.Allocation, &allocInfo));
+        slot.Data  = (uint8_t*)allocInfo.pMappedData;
+        slot.State = ESlotState::Free;
+    }
+
+    void CaptureWriter::DestroySlot(Slot& slot)
+    {
+        vmaDestroyBuffer(mContext->Allocator, slot.Buffer, slot.Allocation);
+        slot.Buffer      = nullptr;
+        slot.Allocation  = nullptr;
+        slot.Data        = nullptr;
+        slot.SignalValue = 0;
+        slot.State       = ESlotState::Free;
+    }
+
+    void CaptureWriter::Update()
+    {
+        if(!IsOpen())
+        {
+            return;
+        }
+        Poll(false);
+        if(!mRecordedOrder.empty() && std::chrono::steady_clock::now() - mSlots[mRecordedOrder.front()].RecordedAt > SIGNAL_TIMEOUT)
+        {
+            FailMissingSignal("a readback was not signalled in time");
+            return;
+        }
+        if(!mStopping || !mRecordedOrder.empty())
+        {
+            return;
+        }
+        if(!mStopWriter)
+        {
+            {
+                std::unique_lock lock(mMutex);
+                mStopWriter = true;
+            }
+            mWorkAvailable.notify_one();
+        }
+        if(mWriterDone)
+        {
+            Finish();
+        }
+    }
+
+    void CaptureWriter::CmdCapture(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo, capture::FrameState&& state)
+    {
+        Assert(IsOpen() && !mStopping, "Bmfr capture is not recording");
+        if(mSignalPending)
+        {  // The previous frame's signal was never requested, so none of the readbacks would ever complete
+            FailMissingSignal("GetFrameSignalInfo() was not requested for the previous frame");
+            return;
+        }
+
+        Slot* slot = nullptr;
+        for(uint32_t i = 0; i < mSlotCount && !slot; i++)
+        {
+            if(mSlots[i].State == ESlotState::Free)
+            {
+                slot = &mSlots[i];
+            }
+        }
+        if(!slot && mSlotCount < MAX_SLOTS)
+        {
+            slot = &mSlots[mSlotCount++];
+            CreateSlot(*slot);
+        }
+        if(!slot)
+        {  // Writer or device are behind. Skip rather than stall the frame
+            mDroppedSinceLast++;
+            mDroppedTotal++;
+            return;
+        }
+
+        slot->Frame                      = std::move(state);
+        slot->Frame.Header.DroppedBefore = mDroppedSinceLast;
+        mDroppedSinceLast                = 0;
+
+        std::vector<VkImageMemoryBarrier2> vkBarriers;
+        for(core::ManagedImage* image : mImages)
+        {
+            core::ImageLayoutCache::Barrier2 barrier{
+                .SrcStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                .SrcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+                .DstStageMask  = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                .DstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+                .NewLayout     = VkImageLayout::VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            };
+            vkBarriers.push_back(renderInfo.GetImageLayoutCache().MakeBarrier(image, barrier));
+        }
+        VkDependencyInfo depInfo{
+            .sType = VkStructureType::VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = (uint32_t)vkBarriers.size(), .pImageMemoryBarriers = vkBarriers.data()};
+        vkCmdPipelineBarrier2(cmdBuffer, &depInfo);
+
+        for(size_t i = 0; i < (size_t)capture::EImage::MaxEnum; i++)
+        {
+            VkBufferImageCopy region{.bufferOffset     = mImageOffsets[i],
+                                     .imageSubresource = VkImageSubresourceLayers{.aspectMask = VkImageAspectFlagBits::VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1U},
+                                     .imageExtent      = VkExtent3D{mHeader.Width, mHeader.Height, 1U}};
+            vkCmdCopyImageToBuffer(cmdBuffer, mImages[i]->GetImage(), VkImageLayout::VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->Buffer, 1U, &region);
+        }
+
+        // Copies are made available by the signal operation of the frame's submit and visible to the host once its value is observed
+        slot->SignalValue = ++mTimelineValue;
+        slot->RecordedAt  = std::chrono::steady_clock::now();
+        slot->State       = ESlotState::Recorded;
+        mSignalPending    = true;
+        mRecordedOrder.push_back((uint32_t)(slot - mSlots));
+    }
+
+    VkSemaphoreSubmitInfo CaptureWriter::GetFrameSignalInfo()
+    {
+        VkSemaphoreSubmitInfo signalInfo{.sType = VkStructureType::VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO};
+        if(mSignalPending)
+        {
+            signalInfo.semaphore = mTimeline;
+            signalInfo.value     = mTimelineValue;
+            signalInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            mSignalPending       = false;
+        }
+        return signalInfo;
+    }
+
+    void CaptureWriter::Poll(bool deviceIdle)
+    {
+        if(mRecordedOrder.empty())
+        {
+            return;
+        }
+        uint64_t completedValue = 0;
+        AssertVkResult(vkGetSemaphoreCounterValue(mContext->Device(), mTimeline, &completedValue));
+        while(!mRecordedOrder.empty())
+        {
+            Slot& slot = mSlots[mRecordedOrder.front()];
+            if(slot.SignalValue > completedValue)
+            {
+                if(!deviceIdle)
+                {
+                    return;
+                }
+                // Only reached after the device went idle: the command buffer was never submitted
+                mRecordedOrder.pop_front();
+                slot.State = ESlotState::Free;
+                mDroppedTotal++;
+                continue;
+            }
+            mRecordedOrder.pop_front();
+            slot.State = ESlotState::Writing;
+            {
+                std::unique_lock lock(mMutex);
+                mWriteQueue.push_back((uint32_t)(&slot - mSlots));
+            }
+            mWorkAvailable.notify_one();
+        }
+    }
+
+    void CaptureWriter::WriterThread()
+    {
+        while(true)
+        {
+            uint32_t slotIdx = 0;
+            {
+                std::unique_lock lock(mMutex);
+                mWorkAvailable.wait(lock, [this] { return !mWriteQueue.empty() || mStopWriter; });
+                if(mWriteQueue.empty())
+                {
+                    break;
+                }
+                slotIdx = mWriteQueue.front();
+                mWriteQueue.pop_front();
+            }
+            Slot& slot = mSlots[slotIdx];
+            WriteFrame(slot);
+            slot.State = ESlotState::Free;
+        }
+        WriteIndex();
+        mWriterDone = true;
+    }
+
+    void CaptureWriter::WriteIndex()
+    {
+        capture::Footer footer{.IndexOffset = (uint64_t)mFile.tellp(), .FrameCount = (uint32_t)mIndex.size()};
+        capture::ChunkHeader chunk{.Type = capture::EChunk::Index, .Size = mIndex.size() * sizeof(capture::IndexEntry)};
+        Write(&chunk, sizeof(chunk));
+        Write(mIndex.data(), mIndex.size() * sizeof(capture::IndexEntry));
+        Write(&footer, sizeof(footer));
+        mFile.close();
+    }
+
+    void CaptureWriter::Write(const void* data, size_t size)
+    {
+        mFile.write((const char*)data, (std::streamsize)size);
+    }
+
+    void CaptureWriter::WriteFrame(Slot& slot)
+    {
+        AssertVkResult(vmaInvalidateAllocation(mContext->Allocator, slot.Allocation, 0, VK_WHOLE_SIZE));
+
+        capture::FrameState& frame = slot.Frame;
+        mIndex.push_back(capture::IndexEntry{.FrameNumber = frame.Header.FrameNumber, .Offset = (uint64_t)mFile.tellp()});
+
+        {  // Frame chunk
+            uint64_t size = sizeof(capture::FrameChunk);
+            for(uint32_t stage = 0; stage < (uint32_t)capture::EStage::MaxEnum; stage++)
+            {
+                frame.Header.PushConstantSizes[stage] = (uint32_t)frame.PushConstants[stage].size();
+                size += frame.PushConstants[stage].size();
+            }
+            capture::ChunkHeader chunk{.Type = capture::EChunk::Frame, .Size = size};
+            Write(&chunk, sizeof(chunk));
+            Write(&frame.Header, sizeof(frame.Header));
+            for(const std::vector<uint8_t>& pushC : frame.PushConstants)
+            {
+                Write(pushC.data(), pushC.size());
+            }
+        }
+
+        for(uint32_t i = 0; i < (uint32_t)capture::EImage::MaxEnum; i++)
+        {
+            VkFormat       format = mHeader.Formats[i];
+            uint64_t       size   = (uint64_t)mHeader.Width * mHeader.Height * capture::GetTexelSize(format);
+            const uint8_t* data   = slot.Data + mImageOffsets[i];
+
+            capture::ImageChunk image{.Image = (capture::EImage)i, .Encoding = capture::EEncoding::Raw, .DecodedSize = size};
+            uint64_t            storedSize = size;
+            if(mOptions.CompressFp16 && capture::IsFp32Format(format))
+            {
+                const fp32_t* values = (const fp32_t*)data;
+                mEncodeBuffer.resize(size / sizeof(fp32_t));
+                for(size_t v = 0; v < mEncodeBuffer.size(); v++)
+                {
+                    mEncodeBuffer[v] = glm::packHalf1x16(values[v]);
+                }
+                image.Encoding = capture::EEncoding::Fp16;
+                data           = (const uint8_t*)mEncodeBuffer.data();
+                storedSize     = mEncodeBuffer.size() * sizeof(uint16_t);
+            }
+
+            capture::ChunkHeader chunk{.Type = capture::EChunk::Image, .Size = sizeof(image) + storedSize};
+            Write(&chunk, sizeof(chunk));
+            Write(&image, sizeof(image));
+            Write(data, storedSize);
+        }
+    }
+
+    void CaptureWriter::FailMissingSignal(const char* reason)
+    {
+        logger()->error("Bmfr capture stopped: {}. The host has to include BmfrDenoiser::GetCaptureSignalInfo() in the submit of every frame", reason);
+        Close();
+    }
+
+    void CaptureWriter::Stop()
+    {
+        mStopping = IsOpen();
+    }
+
+    void CaptureWriter::Close()
+    {
+        if(!IsOpen())
+        {
+            return;
+        }
+
+        // Teardown and missing signals only, stopped captures are finished by Update() without waiting on the device
+        AssertVkResult(vkDeviceWaitIdle(mContext->Device()));
+        Poll(true);
+        {
+            std::unique_lock lock(mMutex);
+            mStopWriter = true;
+        }
+        mWorkAvailable.notify_one();
+        Finish();
+    }
+
+    void CaptureWriter::Finish()
+    {
+        // Writer thread has written the index and closed the file, or is about to
+        mWriter.join();
+
+        // All recorded values were reached, so no pending signal operation references the semaphore
+        for(uint32_t i = 0; i < mSlotCount; i++)
+        {
+            DestroySlot(mSlots[i]);
+        }
+        vkDestroySemaphore(mContext->Device(), mTimeline, nullptr);
+        mTimeline      = nullptr;
+        mSignalPending = false;
+        mSlotCount     = 0;
+        mStopping      = false;
+        mIndex.clear();
+        mEncodeBuffer.clear();
+    }
+
+    void CaptureReplayer::Open(core::Context* context, const std::string& path)
+    {
+        Destroy();
+
+        mFile.open(path, std::ios::binary);
+        Assert(mFile.is_open(), "Bmfr capture file could not be opened");
+        mFile.read((char*)&mHeader, sizeof(mHeader));
+        Assert(!!mFile && mHeader.Magic == capture::MAGIC && mHeader.Version == capture::VERSION, "Bmfr capture file header is invalid or of a different version");
+
+        capture::Footer footer{};
+        mFile.seekg(-(std::streamoff)sizeof(footer), std::ios::end);
+        mFile.read((char*)&footer, sizeof(footer));
+        Assert(!!mFile && footer.Magic == capture::MAGIC, "Bmfr capture file is incomplete (capture was not stopped)");
+
+        capture::ChunkHeader chunk{};
+        mFile.seekg((std::streamoff)footer.IndexOffset);
+        mFile.read((char*)&chunk, sizeof(chunk));
+        Assert(chunk.Type == capture::EChunk::Index && chunk.Size == footer.FrameCount * sizeof(capture::IndexEntry), "Bmfr capture index is invalid");
+        mIndex.resize(footer.FrameCount);
+        mFile.read((char*)mIndex.data(), (std::streamsize)chunk.Size);
+        Assert(!!mFile, "Bmfr capture index is truncated");
+
+        mContext          = context;
+        VkExtent2D extent = VkExtent2D{mHeader.Width, mHeader.Height};
+
+        VkDeviceSize stagingSize = 0;
+        VkImageUsageFlags usage = VkImageUsageFlagBits::VK_IMAGE_USAGE_STORAGE_BIT | VkImageUsageFlagBits::VK_IMAGE_USAGE_TRANSFER_DST_BIT
+                                  | VkImageUsageFlagBits::VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        const char* names[(size_t)capture::EImage::MaxEnum] = {"Bmfr.Replay.Primary", "Bmfr.Replay.Position", "Bmfr.Replay.Normal", "Bmfr.Replay.Albedo",
+                                                                "Bmfr.Replay.Motion"};
+        for(size_t i = 0; i < (size_t)capture::EImage::MaxEnum; i++)
+        {
+            core::ManagedImage::CreateInfo ci(usage, mHeader.Formats[i], extent, names[i]);
+            mImages[i].Create(mContext, ci);
+            mImageOffsets[i] = stagingSize;
+            stagingSize += ((VkDeviceSize)extent.width * extent.height * capture::GetTexelSize(mHeader.Formats[i]) + 15) & ~(VkDeviceSize)15;
+        }
+        {
+            VkImageUsageFlags outputUsage = VkImageUsageFlagBits::VK_IMAGE_USAGE_STORAGE_BIT | VkImageUsageFlagBits::VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            core::ManagedImage::CreateInfo ci(outputUsage, mHeader.OutputFormat, extent, "Bmfr.Replay.Output");
+            mOutput.Create(mContext, ci);
+        }
+
+        for(auto& staging : mStaging)
+        {
+            VkBufferCreateInfo      bufferCi{.sType = VkStructureType::VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                             .size  = stagingSize,
+                                             .usage = VkBufferUsageFlagBits::VK_BUFFER_USAGE_TRANSFER_SRC_BIT};
+            VmaAllocationCreateInfo allocCi{.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                            .usage = VMA_MEMORY_USAGE_AUTO};
+            VmaAllocationInfo       allocInfo{};
+            AssertVkResult(vmaCreateBuffer(mContext->Allocator, &bufferCi, &allocCi, &staging.Buffer, &staging.Allocation, &allocInfo));
+            staging.Data = (uint8_t*)allocInfo.pMappedData;
+        }
+        mNextStaging = 0;
+    }
+
+    void CaptureReplayer::ReadFrame(uint32_t index, uint8_t* staging)
+    {
+        Assert(index < mIndex.size(), "Bmfr capture frame index out of range");
+        mFile.clear();
+        mFile.seekg((std::streamoff)mIndex[index].Offset);
+
+        capture::ChunkHeader chunk{};
+        mFile.read((char*)&chunk, sizeof(chunk));
+        Assert(!!mFile && chunk.Type == capture::EChunk::Frame, "Bmfr capture index does not point at a frame");
+        mFile.read((char*)&mFrame.Header, sizeof(mFrame.Header));
+        uint64_t consumed = sizeof(mFrame.Header);
+        for(uint32_t stage = 0; stage < (uint32_t)capture::EStage::MaxEnum; stage++)
+        {
+            mFrame.PushConstants[stage].resize(mFrame.Header.PushConstantSizes[stage]);
+            mFile.read((char*)mFrame.PushConstants[stage].data(), (std::streamsize)mFrame.PushConstants[stage].size());
+            consumed += mFrame.PushConstants[stage].size();
+        }
+        mFile.seekg((std::streamoff)(chunk.Size - consumed), std::ios::cur);
+
+        uint32_t imagesRead = 0;
+        while(imagesRead < (uint32_t)capture::EImage::MaxEnum)
+        {
+            mFile.read((char*)&chunk, sizeof(chunk));
+            Assert(!!mFile && chunk.Type != capture::EChunk::Frame && chunk.Type != capture::EChunk::Index, "Bmfr capture frame is missing images");
+            if(chunk.Type != capture::EChunk::Image)
+            {
+                mFile.seekg((std::streamoff)chunk.Size, std::ios::cur);
+                continue;
+            }
+
+            capture::ImageChunk image{};
+            mFile.read((char*)&image, sizeof(image));
+            Assert(image.Image < capture::EImage::MaxEnum, "Bmfr capture image chunk is invalid");
+            VkFormat format       = mHeader.Formats[(size_t)image.Image];
+            uint64_t expectedSize = (uint64_t)mHeader.Width * mHeader.Height * capture::GetTexelSize(format);
+            Assert(image.DecodedSize == expectedSize, "Bmfr capture image size does not match the header");
+
+            uint8_t* dst        = staging + mImageOffsets[(size_t)image.Image];
+            uint64_t storedSize = chunk.Size - sizeof(image);
+            if(image.Encoding == capture::EEncoding::Fp16)
+            {
+                Assert(capture::IsFp32Format(format) && storedSize * 2 == image.DecodedSize, "Bmfr capture fp16 image data does not match its decoded size");
+                std::vector<uint16_t> encoded(storedSize / sizeof(uint16_t));
+                mFile.read((char*)encoded.data(), (std::streamsize)storedSize);
+                fp32_t* values = (fp32_t*)dst;
+                for(size_t v = 0; v < encoded.size(); v++)
+                {
+                    values[v] = glm::unpackHalf1x16(encoded[v]);
+                }
+            }
+            else
+            {
+                Assert(storedSize == image.DecodedSize, "Bmfr capture image data does not match its decoded size");
+                mFile.read((char*)dst, (std::streamsize)storedSize);
+            }
+            Assert(!!mFile, "Bmfr capture image data is truncated");
+            imagesRead++;
+        }
+    }
+
+    const capture::FrameState& CaptureReplayer::CmdUploadFrame(VkCommandBuffer cmdBuffer, uint32_t index, base::FrameRenderInfo& renderInfo)
+    {
+        auto& staging = mStaging[mNextStaging];
+        mNextStaging  = (mNextStaging + 1) % STAGING_SLOTS;
+        ReadFrame(index, staging.Data);
+        AssertVkResult(vmaFlushAllocation(mContext->Allocator, staging.Allocation, 0, VK_WHOLE_SIZE));
+
+        // Inputs are overwritten entirely, previous contents are discarded
+        std::vector<VkImageMemoryBarrier2> vkBarriers;
+        for(core::ManagedImage& image : mImages)
+        {
+            core::ImageLayoutCache::Barrier2 barrier{
+                .SrcStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                .SrcAccessMask = VK_ACCESS_2_MEMORY_READ_BIT,
+                .DstStageMask  = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                .DstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                .NewLayout     = VkImageLayout::VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            };
+            vkBarriers.push_back(renderInfo.GetImageLayoutCache().MakeBarrier(image, barrier));
+        }
+        VkDependencyInfo depInfo{
+            .sType = VkStructureType::VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = (uint32_t)vkBarriers.size(), .pImageMemoryBarriers = vkBarriers.data()};
+        vkCmdPipelineBarrier2(cmdBuffer, &depInfo);
+
+        for(size_t i = 0; i < (size_t)capture::EImage::MaxEnum; i++)
+        {
+            VkBufferImageCopy region{.bufferOffset     = mImageOffsets[i],
+                                     .imageSubresource = VkImageSubresourceLayers{.aspectMask = VkImageAspectFlagBits::VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1U},
+                                     .imageExtent      = VkExtent3D{mHeader.Width, mHeader.Height, 1U}};
+            vkCmdCopyBufferToImage(cmdBuffer, staging.Buffer, mImages[i].GetImage(), VkImageLayout::VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1U, &region);
+        }
+        return mFrame;
+    }
+
+    void CaptureReplayer::Destroy()
+    {
+        if(!mContext)
+        {
+            return;
+        }
+        for(auto& staging : mStaging)
+        {
+            vmaDestroyBuffer(mContext->Allocator, staging.Buffer, staging.Allocation);
+            staging.Buffer     = nullptr;
+            staging.Allocation = nullptr;
+            staging.Data       = nullptr;
+        }
+        for(core::ManagedImage& image : mImages)
+        {
+            image.Destroy();
+        }
+        mOutput.Destroy();
+        mFile.close();
+        mIndex.clear();
+        mContext = nullptr;
+    }
+
+}  // namespace foray::bmfr
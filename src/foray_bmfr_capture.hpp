@@ -0,0 +1,289 @@
+#pragma once
+#include <atomic>
+#include <base/foray_framerenderinfo.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <core/foray_managedimage.hpp>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace foray::bmfr {
+    /// @brief Binary layout of denoiser capture files
+    /// @details
+    ///  FileHeader
+    ///  per frame: ChunkHeader(Frame) FrameChunk + push constant bytes
+    ///             ChunkHeader(Image) ImageChunk + image data, once per EImage in order
+    ///  ChunkHeader(Index) IndexEntry[FrameCount]
+    ///  Footer
+    /// Readers skip chunk types they do not know by their size. All values are little endian as written by the host.
+    namespace capture {
+        inline constexpr uint32_t MAGIC   = 0x43464D42;  // "BMFC"
+        inline constexpr uint32_t VERSION = 2;
+
+        enum class EImage : uint32_t
+        {
+            Primary,
+            Position,
+            Normal,
+            Albedo,
+            Motion,
+            MaxEnum
+        };
+
+        enum class EChunk : uint32_t
+        {
+            Frame = 1,
+            Image = 2,
+            Index = 3,
+        };
+
+        enum class EEncoding : uint32_t
+        {
+            /// @brief Texels exactly as read back from the image
+            Raw = 0,
+            /// @brief 32 bit float channels rounded to half floats. Lossy: shaders read 32 bit float images at full precision regardless of the
+            /// rgba16f format qualifier, so replays differ (world positions in particular)
+            Fp16 = 1,
+        };
+
+        /// @brief Push constant blocks of the stages, in recording order
+        enum class EStage : uint32_t
+        {
+            PreProcess,
+            Regression,
+            PostProcess,
+            MaxEnum
+        };
+
+        struct FileHeader
+        {
+            uint32_t Magic   = MAGIC;
+            uint32_t Version = VERSION;
+            uint32_t Width   = 0;
+            uint32_t Height  = 0;
+            /// @brief Input formats, indexed by EImage
+            VkFormat Formats[(uint32_t)EImage::MaxEnum]{};
+            VkFormat OutputFormat = VkFormat::VK_FORMAT_UNDEFINED;
+            /// @brief FeatureSet the capture was taken with
+            uint32_t Features  = 0;
+            uint32_t BlockEdge = 0;
+            /// @brief TuningConfig the capture was taken with
+            uint32_t PreProcessLocalSize[2]{};
+            uint32_t RegressionLocalSize = 0;
+            uint32_t PostProcessLocalSize[2]{};
+            /// @brief Regression scratch precision (SCRATCH_*) the capture was taken with
+            uint32_t Precision = 0;
+        };
+
+        struct ChunkHeader
+        {
+            EChunk   Type;
+            uint32_t Reserved = 0;
+            /// @brief Size of the chunk body following this header
+            uint64_t Size;
+        };
+
+        struct FrameChunk
+        {
+            uint64_t FrameNumber = 0;
+            /// @brief False if history was ignored for this frame (IgnoreHistoryNextFrame, resize, first frame)
+            uint32_t HistoryValid = 0;
+            uint32_t DebugMode    = 0;
+            /// @brief Frames skipped since the previous captured frame, because no readback slot was free
+            uint32_t DroppedBefore = 0;
+            uint32_t PushConstantSizes[(uint32_t)EStage::MaxEnum]{};
+        };
+
+        struct ImageChunk
+        {
+            EImage    Image;
+            EEncoding Encoding;
+            /// @brief Size of the image data after decoding (tightly packed texels in the captured format)
+            uint64_t DecodedSize;
+        };
+
+        struct IndexEntry
+        {
+            uint64_t FrameNumber;
+            /// @brief File offset of the frame's ChunkHeader
+            uint64_t Offset;
+        };
+
+        struct Footer
+        {
+            uint64_t IndexOffset;
+            uint32_t FrameCount;
+            uint32_t Magic = MAGIC;
+        };
+
+        /// @brief Frame state besides the input images
+        struct FrameState
+        {
+            FrameChunk           Header;
+            std::vector<uint8_t> PushConstants[(uint32_t)EStage::MaxEnum];
+        };
+
+        /// @brief Size of a texel. Asserts the format is supported for capturing
+        uint32_t GetTexelSize(VkFormat format);
+        /// @brief True if all channels of the format are 32 bit floats
+        bool IsFp32Format(VkFormat format);
+    }  // namespace capture
+
+    /// @brief Writes denoiser inputs and state of every frame to a capture file
+    /// @details Inputs are copied into host visible readback buffers at the end of the frame. The submit of the frame signals a timeline
+    /// semaphore (GetFrameSignalInfo()), whose counter is polled once per frame, so the recording thread never waits on the device. Encoding and
+    /// file I/O run on a writer thread. If all readback slots are still in use, the frame is skipped and counted in the next frame's
+    /// DroppedBefore. Input images need VK_IMAGE_USAGE_TRANSFER_SRC_BIT.
+    /// If the host does not submit the signal (the signal info is not requested before the next capture, or a readback does not complete
+    /// within SIGNAL_TIMEOUT), an error is logged and the capture is closed, waiting for the device once.
+    class CaptureWriter
+    {
+      public:
+        struct Options
+        {
+            /// @brief Store 32 bit float inputs as half floats. Lossy, halves their size (see capture::EEncoding::Fp16)
+            bool CompressFp16 = false;
+        };
+
+        /// @brief Opens the file and writes the header. Header formats and extent are taken from images. Closes a previous capture, waiting
+        /// for the device if it is still draining
+        void Open(core::Context* context, const std::string& path, const Options& options, capture::FileHeader header,
+                  core::ManagedImage* const (&images)[(size_t)capture::EImage::MaxEnum]);
+        /// @brief Hands completed readbacks to the writer thread and finishes a stopped capture once all of them are written. Call once per frame
+        void Update();
+        /// @brief Records the input copies for this frame. Images are left in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+        void CmdCapture(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo, capture::FrameState&& state);
+        /// @brief Signal operation the submit of the command buffer passed to CmdCapture(...) has to include. Semaphore is nullptr if no copies
+        /// were recorded since the last call, so call it exactly once per submit
+        VkSemaphoreSubmitInfo GetFrameSignalInfo();
+        /// @brief Stops capturing. Outstanding readbacks are written and the file is finished over the following Update() calls
+        void Stop();
+        /// @brief Waits for the device, writes outstanding readbacks and finishes the file
+        void Close();
+
+        /// @brief True until a stopped capture has been finished
+        inline bool     IsOpen() const { return mWriter.joinable(); }
+        inline bool     IsStopping() const { return mStopping; }
+        inline uint32_t GetDroppedFrameCount() const { return mDroppedTotal; }
+
+        /// @brief Readback slots are created on demand up to this count
+        inline static const uint32_t MAX_SLOTS = 8;
+        /// @brief A readback not completed after this long is assumed to never be signalled
+        inline static const std::chrono::seconds SIGNAL_TIMEOUT{5};
+
+      protected:
+        enum class ESlotState : uint32_t
+        {
+            Free,
+            /// @brief Copy recorded, timeline value not yet reached
+            Recorded,
+            /// @brief Owned by the writer thread
+            Writing,
+        };
+
+        struct Slot
+        {
+            VkBuffer                Buffer     = nullptr;
+            VmaAllocation           Allocation = nullptr;
+            uint8_t*                Data       = nullptr;
+            /// @brief Timeline value signalled by the submit containing the copies
+            uint64_t                SignalValue = 0;
+            std::chrono::steady_clock::time_point RecordedAt;
+            std::atomic<ESlotState> State{ESlotState::Free};
+            capture::FrameState     Frame;
+        };
+
+        void CreateSlot(Slot& slot);
+        void DestroySlot(Slot& slot);
+        /// @brief Hands slots whose copies completed to the writer thread, in recording order
+        /// @param deviceIdle If set, slots whose value was not reached were never submitted and are discarded
+        void Poll(bool deviceIdle);
+        /// @brief Logs why the host does not signal the readbacks and closes the capture
+        void FailMissingSignal(const char* reason);
+        /// @brief Joins the writer thread, which has written index and footer, and releases the readback resources
+        void Finish();
+        void WriterThread();
+        void WriteFrame(Slot& slot);
+        void WriteIndex();
+        void Write(const void* data, size_t size);
+
+        core::Context*        mContext = nullptr;
+        Options               mOptions;
+        capture::FileHeader   mHeader;
+        core::ManagedImage*   mImages[(size_t)capture::EImage::MaxEnum]{};
+        VkDeviceSize          mImageOffsets[(size_t)capture::EImage::MaxEnum]{};
+        VkDeviceSize          mSlotSize = 0;
+        std::ofstream         mFile;
+        std::vector<capture::IndexEntry> mIndex;
+
+        Slot                 mSlots[MAX_SLOTS];
+        uint32_t             mSlotCount = 0;
+        std::deque<uint32_t> mRecordedOrder;
+        uint32_t             mDroppedSinceLast = 0;
+        uint32_t             mDroppedTotal     = 0;
+        bool                 mStopping         = false;
+
+        VkSemaphore mTimeline      = nullptr;
+        uint64_t    mTimelineValue = 0;
+        /// @brief Set by CmdCapture until GetFrameSignalInfo() hands out the value
+        bool        mSignalPending = false;
+
+        std::thread             mWriter;
+        std::mutex              mMutex;
+        std::condition_variable mWorkAvailable;
+        std::deque<uint32_t>    mWriteQueue;
+        /// @brief Writer thread writes the index and exits once the queue is empty
+        bool                    mStopWriter = false;
+        std::atomic<bool>       mWriterDone{false};
+        /// @brief Writer thread only
+        std::vector<uint16_t>   mEncodeBuffer;
+    };
+
+    /// @brief Reads a capture file and uploads its frames into images of the captured formats
+    /// @details Frames are decoded on the recording thread. Staging buffers are reused every STAGING_SLOTS frames, so at most that many
+    /// replayed frames may be in flight on the device.
+    class CaptureReplayer
+    {
+      public:
+        /// @brief Reads header and index and creates input and output images
+        void Open(core::Context* context, const std::string& path);
+        void Destroy();
+
+        inline const capture::FileHeader& GetHeader() const { return mHeader; }
+        inline uint32_t                   GetFrameCount() const { return (uint32_t)mIndex.size(); }
+        inline core::ManagedImage*        GetImage(capture::EImage image) { return &mImages[(size_t)image]; }
+        inline core::ManagedImage*        GetOutput() { return &mOutput; }
+
+        /// @brief Reads frame index, records the upload of its inputs and returns its state
+        const capture::FrameState& CmdUploadFrame(VkCommandBuffer cmdBuffer, uint32_t index, base::FrameRenderInfo& renderInfo);
+
+        inline bool Exists() const { return !!mContext; }
+
+        inline static const uint32_t STAGING_SLOTS = 4;
+
+      protected:
+        void ReadFrame(uint32_t index, uint8_t* staging);
+
+        core::Context*                   mContext = nullptr;
+        std::ifstream                    mFile;
+        capture::FileHeader              mHeader;
+        std::vector<capture::IndexEntry> mIndex;
+        capture::FrameState              mFrame;
+
+        core::ManagedImage mImages[(size_t)capture::EImage::MaxEnum];
+        core::ManagedImage mOutput;
+        VkDeviceSize       mImageOffsets[(size_t)capture::EImage::MaxEnum]{};
+
+        struct
+        {
+            VkBuffer      Buffer     = nullptr;
+            VmaAllocation Allocation = nullptr;
+            uint8_t*      Data       = nullptr;
+        } mStaging[STAGING_SLOTS];
+        uint32_t mNextStaging = 0;
+    };
+}  // namespace foray::bmfr
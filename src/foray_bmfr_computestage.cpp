@@ -0,0 +1,41 @@
+#include "foray_bmfr_computestage.hpp"
+
+namespace foray::bmfr {
+    void BmfrComputeStageBase::RebuildPipeline()
+    {
+        if(!!mPipeline)
+        {
+            vkDestroyPipeline(mContext->Device(), mPipeline, nullptr);
+            mPipeline = nullptr;
+        }
+        CreatePipeline();
+    }
+
+    void BmfrComputeStageBase::CreatePipeline()
+    {
+        std::vector<uint32_t> values;
+        ApiGetSpecializationConstants(values);
+
+        std::vector<VkSpecializationMapEntry> mapEntries(values.size());
+        for(uint32_t i = 0; i < (uint32_t)values.size(); i++)
+        {
+            mapEntries[i] = VkSpecializationMapEntry{.constantID = i, .offset = i * (uint32_t)sizeof(uint32_t), .size = sizeof(uint32_t)};
+        }
+
+        VkSpecializationInfo specializationInfo{.mapEntryCount = (uint32_t)mapEntries.size(),
+                                                .pMapEntries   = mapEntries.data(),
+                                                .dataSize      = values.size() * sizeof(uint32_t),
+                                                .pData         = values.data()};
+
+        VkPipelineShaderStageCreateInfo shaderStageCi{.sType               = VkStructureType::VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                                                      .stage               = VkShaderStageFlagBits::VK_SHADER_STAGE_COMPUTE_BIT,
+                                                      .module              = mShader,
+                                                      .pName               = "main",
+                                                      .pSpecializationInfo = &specializationInfo};
+
+        VkComputePipelineCreateInfo pipelineCi{
+            .sType = VkStructureType::VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, .stage = shaderStageCi, .layout = mPipelineLayout};
+
+        AssertVkResult(vkCreateComputePipelines(mContext->Device(), nullptr, 1U, &pipelineCi, nullptr, &mPipeline));
+    }
+}  // namespace foray::bmfr
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stages/foray_computestage.hpp>
+#include <vector>
+
+namespace foray::bmfr {
+    /// @brief Compute stage base building its pipeline with specialization constants
+    class BmfrComputeStageBase : public foray::stages::ComputeStageBase
+    {
+      public:
+        /// @brief Recreates the pipeline with the current specialization constants. Pipeline must not be in use by the device
+        void RebuildPipeline();
+
+      protected:
+        /// @brief Fills specialization constant values. Index in the vector is the constant_id in the shader
+        virtual void ApiGetSpecializationConstants(std::vector<uint32_t>& values) = 0;
+
+        virtual void CreatePipeline() override;
+    };
+}  // namespace foray::bmfr
@@ -0,0 +1,193 @@
+#include "foray_bmfr_externalmemory.hpp"
+#include <core/foray_context.hpp>
+
+namespace foray::bmfr {
+    VkFormat ExternalMemoryInterop::GetExpectedFormat(EImage image)
+    {
+        switch(image)
+        {
+            case EImage::Motion:
+                return VkFormat::VK_FORMAT_R16G16_SFLOAT;
+            default:
+                return VkFormat::VK_FORMAT_R16G16B16A16_SFLOAT;
+        }
+    }
+
+    void ExternalMemoryInterop::Create(core::Context* context, const CreateInfo& createInfo)
+    {
+        Destroy();
+        mContext = context;
+        mExtent  = createInfo.Extent;
+        mQueueFamilyIndex = createInfo.QueueFamilyIndex;
+
+        for(size_t i = 0; i < (size_t)EImage::MaxEnum; i++)
+        {
+            Assert(createInfo.Formats[i] == GetExpectedFormat((EImage)i), "Bmfr external image format declared by the importer does not match the shaders");
+        }
+        Assert(mExtent.width > 0 && mExtent.height > 0, "Bmfr external image extent must not be zero");
+
+        {  // Pool chaining the export info into every allocation
+            core::ManagedImage::CreateInfo probeCi(VkImageUsageFlagBits::VK_IMAGE_USAGE_STORAGE_BIT, GetExpectedFormat(EImage::Primary), mExtent, "");
+            probeCi.ImageCI.pNext = &mExternalImageCi;
+
+            uint32_t memoryTypeIndex = 0;
+            AssertVkResult(vmaFindMemoryTypeIndexForImageInfo(mContext->Allocator, &probeCi.ImageCI, &probeCi.AllocationCI, &memoryTypeIndex));
+
+            VmaPoolCreateInfo poolCi{.memoryTypeIndex = memoryTypeIndex, .pMemoryAllocateNext = &mExportAllocInfo};
+            AssertVkResult(vmaCreatePool(mContext->Allocator, &poolCi, &mPool));
+        }
+
+        CreateImages();
+
+        mInputsReady = ImportSemaphore(createInfo.InputsReadySemaphoreFd, "Bmfr.External.InputsReady");
+        mOutputReady = ImportSemaphore(createInfo.OutputReadySemaphoreFd, "Bmfr.External.OutputReady");
+    }
+
+    void ExternalMemoryInterop::CreateImages()
+    {
+        for(size_t i = 0; i < (size_t)EImage::MaxEnum; i++)
+        {
+            core::ManagedImage::CreateInfo ci(IMAGE_USAGE, GetExpectedFormat((EImage)i), mExtent, IMAGE_NAMES[i]);
+            ci.ImageCI.pNext       = &mExternalImageCi;
+            ci.AllocationCI.pool   = mPool;
+            ci.AllocationCI.flags |= VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;  // One VkDeviceMemory per image, offset 0
+            mImages[i].Create(mContext, ci);
+        }
+        mOutputFirstUse = true;
+    }
+
+    VkSemaphore ExternalMemoryInterop::ImportSemaphore(int fd, const char* name)
+    {
+        if(fd < 0)
+        {
+            return nullptr;
+        }
+
+        VkSemaphore           semaphore = nullptr;
+        VkSemaphoreCreateInfo semaphoreCi{.sType = VkStructureType::VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+        AssertVkResult(vkCreateSemaphore(mContext->Device(), &semaphoreCi, nullptr, &semaphore));
+
+        auto vkImportSemaphoreFd = (PFN_vkImportSemaphoreFdKHR)vkGetDeviceProcAddr(mContext->Device(), "vkImportSemaphoreFdKHR");
+        Assert(!!vkImportSemaphoreFd, "VK_KHR_external_semaphore_fd not enabled");
+
+        VkImportSemaphoreFdInfoKHR importInfo{.sType      = VkStructureType::VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR,
+                                              .semaphore  = semaphore,
+                                              .handleType = VkExternalSemaphoreHandleTypeFlagBits::VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT,
+                                              .fd         = fd};
+        AssertVkResult(vkImportSemaphoreFd(mContext->Device(), &importInfo));
+        return semaphore;
+    }
+
+    void ExternalMemoryInterop::Resize(const VkExtent2D& size)
+    {
+        if(!Exists())
+        {
+            return;
+        }
+        mExtent = size;
+        // The images may still be read or written by in flight denoiser submits
+        AssertVkResult(vkDeviceWaitIdle(mContext->Device()));
+        for(core::ManagedImage& image : mImages)
+        {
+            image.Destroy();
+        }
+        CreateImages();
+    }
+
+    ExternalMemoryInterop::MemoryExport ExternalMemoryInterop::ExportMemoryFd(EImage image)
+    {
+        auto vkGetMemoryFd = (PFN_vkGetMemoryFdKHR)vkGetDeviceProcAddr(mContext->Device(), "vkGetMemoryFdKHR");
+        Assert(!!vkGetMemoryFd, "VK_KHR_external_memory_fd not enabled");
+
+        VmaAllocationInfo allocInfo{};
+        vmaGetAllocationInfo(mContext->Allocator, mImages[(size_t)image].GetAllocation(), &allocInfo);
+
+        VkMemoryGetFdInfoKHR getFdInfo{.sType      = VkStructureType::VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR,
+                                       .memory     = allocInfo.deviceMemory,
+                                       .handleType = VkExternalMemoryHandleTypeFlagBits::VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT};
+        MemoryExport result{.AllocationSize = allocInfo.size, .Offset = allocInfo.offset};
+        AssertVkResult(vkGetMemoryFd(mContext->Device(), &getFdInfo, &result.Fd));
+        return result;
+    }
+
+    void ExternalMemoryInterop::CmdAcquire(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo)
+    {
+        CmdOwnershipTransfer(cmdBuffer, renderInfo, true);
+        mOutputFirstUse = false;
+    }
+
+    void ExternalMemoryInterop::CmdRelease(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo)
+    {
+        CmdOwnershipTransfer(cmdBuffer, renderInfo, false);
+    }
+
+    void ExternalMemoryInterop::CmdOwnershipTransfer(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo, bool acquire)
+    {
+        std::vector<VkImageMemoryBarrier2> vkBarriers;
+        for(size_t i = 0; i < (size_t)EImage::MaxEnum; i++)
+        {
+            core::ManagedImage* image = &mImages[i];
+            // Contents of a not yet released output are undefined, it is transitioned from VK_IMAGE_LAYOUT_UNDEFINED without ownership transfer
+            bool transfer = !(acquire && (EImage)i == EImage::Output && mOutputFirstUse);
+            if(acquire && transfer)
+            {  // Layout the other process released the image in. Without this the cache would transition from VK_IMAGE_LAYOUT_UNDEFINED
+                renderInfo.GetImageLayoutCache().Set(*image, VkImageLayout::VK_IMAGE_LAYOUT_GENERAL);
+            }
+            // The acquire's source scope has to include the stages of the inputs ready wait (GetInputsReadyWaitInfo()) to chain with it
+            core::ImageLayoutCache::Barrier2 barrier{
+                .SrcStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                .SrcAccessMask = acquire ? VK_ACCESS_2_NONE : VK_ACCESS_2_MEMORY_WRITE_BIT,
+                .DstStageMask  = acquire ? VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT : VK_PIPELINE_STAGE_2_NONE,
+                .DstAccessMask = acquire ? VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT : VK_ACCESS_2_NONE,
+                .NewLayout     = VkImageLayout::VK_IMAGE_LAYOUT_GENERAL,
+            };
+            VkImageMemoryBarrier2 vkBarrier = renderInfo.GetImageLayoutCache().MakeBarrier(image, barrier);
+            if(transfer)
+            {
+                vkBarrier.srcQueueFamilyIndex = acquire ? VK_QUEUE_FAMILY_EXTERNAL : mQueueFamilyIndex;
+                vkBarrier.dstQueueFamilyIndex = acquire ? mQueueFamilyIndex : VK_QUEUE_FAMILY_EXTERNAL;
+            }
+            vkBarriers.push_back(vkBarrier);
+        }
+
+        VkDependencyInfo depInfo{
+            .sType = VkStructureType::VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = (uint32_t)vkBarriers.size(), .pImageMemoryBarriers = vkBarriers.data()};
+        vkCmdPipelineBarrier2(cmdBuffer, &depInfo);
+    }
+
+    VkSemaphoreSubmitInfo ExternalMemoryInterop::GetInputsReadyWaitInfo() const
+    {
+        // Inputs are read by the stage shaders and by the transfers of history and capture copies, after the acquire barrier
+        return VkSemaphoreSubmitInfo{.sType     = VkStructureType::VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                                     .semaphore = mInputsReady,
+                                     .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT};
+    }
+
+    VkSemaphoreSubmitInfo ExternalMemoryInterop::GetOutputReadySignalInfo() const
+    {
+        return VkSemaphoreSubmitInfo{.sType     = VkStructureType::VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                                     .semaphore = mOutputReady,
+                                     .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT};
+    }
+
+    void ExternalMemoryInterop::Destroy()
+    {
+        for(core::ManagedImage& image : mImages)
+        {
+            image.Destroy();
+        }
+        if(!!mPool)
+        {
+            vmaDestroyPool(mContext->Allocator, mPool);
+            mPool = nullptr;
+        }
+        for(VkSemaphore* semaphore : {&mInputsReady, &mOutputReady})
+        {
+            if(!!*semaphore)
+            {
+                vkDestroySemaphore(mContext->Device(), *semaphore, nullptr);
+                *semaphore = nullptr;
+            }
+        }
+    }
+}  // namespace foray::bmfr
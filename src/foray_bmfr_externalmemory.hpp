@@ -0,0 +1,116 @@
+#pragma once
+#include <base/foray_framerenderinfo.hpp>
+#include <core/foray_managedimage.hpp>
+
+namespace foray::bmfr {
+
+    /// @brief Denoiser input and output images backed by device memory shareable with another process via opaque file descriptors
+    /// @details The images are created with the exact formats the BMFR shaders bind them as, so the producer process imports the exported
+    /// memory and renders into it directly, and the compositor reads the output in place. Ownership stays with the application, like any other
+    /// denoiser input. Requires VK_KHR_external_memory_fd and VK_KHR_external_semaphore_fd to be enabled on the device.
+    /// Images are exchanged in VK_IMAGE_LAYOUT_GENERAL with ownership transfers through VK_QUEUE_FAMILY_EXTERNAL: the producer releases the
+    /// inputs and the compositor releases the output (except before its first use) before the denoiser submit, and acquires them afterwards.
+    ///
+    /// Importing processes have to match the exporting image exactly:
+    ///  - Same physical device and driver: VkPhysicalDeviceIDProperties::deviceUUID and driverUUID equal those of this device
+    ///  - VkImageCreateInfo: VK_IMAGE_TYPE_2D, GetExpectedFormat(...), the interop extent, 1 mip level, 1 array layer, VK_SAMPLE_COUNT_1_BIT,
+    ///    VK_IMAGE_TILING_OPTIMAL, IMAGE_USAGE, VK_SHARING_MODE_EXCLUSIVE, no flags, chained VkExternalMemoryImageCreateInfo with
+    ///    VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT
+    ///  - Memory: every image has a dedicated allocation. Import it with VkImportMemoryFdInfoKHR, MemoryExport::AllocationSize and a chained
+    ///    VkMemoryDedicatedAllocateInfo naming the importing image, then bind at MemoryExport::Offset
+    class ExternalMemoryInterop
+    {
+      public:
+        enum class EImage
+        {
+            Primary,
+            Position,
+            Normal,
+            Albedo,
+            Motion,
+            Output,
+            MaxEnum
+        };
+
+        struct CreateInfo
+        {
+            /// @brief Importing processes have to create their images with this extent and GetExpectedFormat(...)
+            VkExtent2D Extent{};
+            /// @brief Formats the importing process creates its images with, indexed by EImage. Asserted to equal GetExpectedFormat(...)
+            VkFormat Formats[(size_t)EImage::MaxEnum]{};
+            /// @brief Queue family of the queue BmfrDenoiser::RecordFrame is submitted to
+            uint32_t QueueFamilyIndex = 0;
+            /// @brief Binary semaphore signalled by the producer once all inputs are written. -1 if no semaphore is imported
+            int InputsReadySemaphoreFd = -1;
+            /// @brief Binary semaphore signalled by the denoiser submit once the output is written. -1 if no semaphore is imported
+            int OutputReadySemaphoreFd = -1;
+        };
+
+        struct MemoryExport
+        {
+            /// @brief Opaque file descriptor. Ownership passes to the caller (close it, or hand it to the importing process)
+            int          Fd = -1;
+            VkDeviceSize AllocationSize = 0;
+            VkDeviceSize Offset         = 0;
+        };
+
+        /// @brief Creates the images with exportable memory and imports the semaphores (importing transfers fd ownership)
+        void Create(core::Context* context, const CreateInfo& createInfo);
+        /// @brief Waits for the device to idle and recreates all images. Previously exported memory is no longer bound, so fds have to be exported
+        /// and handed out again. If a BmfrDenoiser is initialized from this interop, call BmfrDenoiser::Resize instead, which resizes the interop
+        /// and then its own images and descriptor sets
+        void Resize(const VkExtent2D& size);
+        void Destroy();
+
+        /// @brief Exports a new file descriptor referencing the memory of an image
+        MemoryExport ExportMemoryFd(EImage image);
+
+        /// @brief Format the BMFR shaders declare for the storage image binding
+        static VkFormat GetExpectedFormat(EImage image);
+        inline VkExtent2D GetExtent() const { return mExtent; }
+
+        /// @brief Usage all images are created with. Importing images have to use the same flags
+        inline static const VkImageUsageFlags IMAGE_USAGE = VkImageUsageFlagBits::VK_IMAGE_USAGE_STORAGE_BIT | VkImageUsageFlagBits::VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+                                                            | VkImageUsageFlagBits::VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+        inline core::ManagedImage* GetImage(EImage image) { return &mImages[(size_t)image]; }
+
+        /// @brief Acquires all images from VK_QUEUE_FAMILY_EXTERNAL and seeds the layout cache, so the stage barriers keep their contents
+        void CmdAcquire(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo);
+        /// @brief Releases all images to VK_QUEUE_FAMILY_EXTERNAL in VK_IMAGE_LAYOUT_GENERAL
+        void CmdRelease(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo);
+
+        /// @brief Wait info for the submit recording BmfrDenoiser::RecordFrame. Semaphore is nullptr if none was imported
+        VkSemaphoreSubmitInfo GetInputsReadyWaitInfo() const;
+        /// @brief Signal info for the submit recording BmfrDenoiser::RecordFrame. Semaphore is nullptr if none was imported
+        VkSemaphoreSubmitInfo GetOutputReadySignalInfo() const;
+
+        inline bool Exists() const { return !!mPool; }
+
+      protected:
+        void CreateImages();
+        VkSemaphore ImportSemaphore(int fd, const char* name);
+        void        CmdOwnershipTransfer(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo, bool acquire);
+
+        core::Context* mContext = nullptr;
+        VkExtent2D     mExtent{};
+        uint32_t       mQueueFamilyIndex = 0;
+        /// @brief The output has not been released by the compositor yet, as it has never been handed out (after Create or Resize)
+        bool           mOutputFirstUse = true;
+
+        core::ManagedImage mImages[(size_t)EImage::MaxEnum];
+
+        VmaPool mPool = nullptr;
+
+        VkExternalMemoryImageCreateInfo mExternalImageCi{.sType       = VkStructureType::VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO,
+                                                         .handleTypes = VkExternalMemoryHandleTypeFlagBits::VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT};
+        VkExportMemoryAllocateInfo      mExportAllocInfo{.sType       = VkStructureType::VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO,
+                                                         .handleTypes = VkExternalMemoryHandleTypeFlagBits::VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT};
+
+        VkSemaphore mInputsReady = nullptr;
+        VkSemaphore mOutputReady = nullptr;
+
+        inline static const char* IMAGE_NAMES[(size_t)EImage::MaxEnum] = {"Bmfr.External.Primary", "Bmfr.External.Position", "Bmfr.External.Normal",
+                                                                           "Bmfr.External.Albedo",  "Bmfr.External.Motion",   "Bmfr.External.Output"};
+    };
+}  // namespace foray::bmfr
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+
+namespace foray::bmfr {
+    /// @brief Describes the regression features and block size regression.comp is specialized with
+    /// @details Features always include the constant 1. Each enabled feature adds three channels in the order normal, albedo, position, position squared.
+    /// Fewer features make the per block QR decomposition cheaper, larger blocks reduce per block overhead at high resolutions.
+    struct FeatureSet
+    {
+        enum EFeatureBits : uint32_t
+        {
+            Normal          = 1 << 0,
+            Albedo          = 1 << 1,
+            Position        = 1 << 2,
+            PositionSquared = 1 << 3,
+        };
+
+        inline static constexpr uint32_t DEFAULT_BLOCK_EDGE = 32;
+
+        uint32_t Features  = Normal | Position | PositionSquared;
+        /// @brief Edge length of a regression block in pixels (16, 32 or 64)
+        uint32_t BlockEdge = DEFAULT_BLOCK_EDGE;
+
+        inline bool     Has(EFeatureBits feature) const { return (Features & feature) > 0; }
+        /// @brief Number of features including the constant 1 (FEATURES_COUNT in regression.comp)
+        inline uint32_t GetFeatureCount() const { return 1 + 3 * ((uint32_t)Has(Normal) + (uint32_t)Has(Albedo) + (uint32_t)Has(Position) + (uint32_t)Has(PositionSquared)); }
+        /// @brief Features plus the three noisy color channels (BUFFERS_COUNT in regression.comp)
+        inline uint32_t GetBufferCount() const { return GetFeatureCount() + 3; }
+        inline uint32_t GetBlockSize() const { return BlockEdge * BlockEdge; }
+
+        inline bool operator==(const FeatureSet& other) const { return Features == other.Features && BlockEdge == other.BlockEdge; }
+        inline bool operator!=(const FeatureSet& other) const { return !(*this == other); }
+
+        /// @brief Original BMFR feature set: constant, normal, position, position squared (10 features)
+        inline static FeatureSet Default() { return FeatureSet{}; }
+        /// @brief Constant, normal, position (7 features)
+        inline static FeatureSet Cheap() { return FeatureSet{.Features = Normal | Position}; }
+        /// @brief Default set plus albedo (13 features)
+        inline static FeatureSet Extended() { return FeatureSet{.Features = Normal | Albedo | Position | PositionSquared}; }
+    };
+}  // namespace foray::bmfr
@@ -0,0 +1,31 @@
+#pragma once
+#include "shaders/foveation.glsl.h"
+#include <core/foray_managedimage.hpp>
+
+namespace foray::bmfr {
+    /// @brief Region weighted denoising quality, e.g. for headset rendering
+    /// @details Peripheral regression blocks fit fewer features (cheaper QR), peripheral postprocess pixels reproject history from the nearest
+    /// texel instead of a bilinear footprint.
+    struct FoveationConfig
+    {
+        uint32_t Mode = FOVEATION_OFF;
+        /// @brief Gaze point in normalized screen coordinates (FOVEATION_GAZE)
+        glm::vec2 Gaze = glm::vec2(0.5f);
+        /// @brief Full quality within this distance of the gaze point, relative to render height (FOVEATION_GAZE)
+        fp32_t InnerRadius = 0.2f;
+        /// @brief Minimum quality beyond this distance of the gaze point, relative to render height (FOVEATION_GAZE)
+        fp32_t OuterRadius = 0.5f;
+        /// @brief R8_UNORM storage image, 1 = full quality. Any resolution, sampled nearest (FOVEATION_MAP).
+        /// Must be in VK_IMAGE_LAYOUT_GENERAL when BmfrDenoiser::RecordFrame's command buffer executes
+        core::ManagedImage* Map = nullptr;
+    };
+
+    /// @brief Push constant block shared by the regression and postprocess stages
+    struct FoveationPushConstant
+    {
+        glm::vec2 Gaze;
+        fp32_t    InnerRadius;
+        fp32_t    OuterRadius;
+        uint32_t  Mode;
+    };
+}  // namespace foray::bmfr
@@ -13,6 +13,11 @@ namespace foray::bmfr {
     {
         mShaderKeys.push_back(mShader.CompileFromSource(mContext, BMFR_SHADER_DIR "/postprocess.comp"));
     }
+    void PostProcessStage::ApiGetSpecializationConstants(std::vector<uint32_t>& values)
+    {
+        glm::uvec2 localSize = mBmfrStage->mTuning.PostProcessLocalSize;
+        values               = {localSize.x, localSize.y, (uint32_t)mBmfrStage->mHistoryTileCache};
+    }
     void PostProcessStage::ApiCreateDescriptorSet()
     {
         UpdateDescriptorSet();
@@ -20,7 +25,8 @@ namespace foray::bmfr {
     void PostProcessStage::UpdateDescriptorSet()
     {
         std::vector<core::ManagedImage*> images(
-            {&mBmfrStage->mFilterImage, &mBmfrStage->mAccuImages.Filtered, mBmfrStage->mInputs.Motion, &mBmfrStage->mAccuImages.AcceptBools, mBmfrStage->mPrimaryOutput});
+            {&mBmfrStage->mFilterImage, &mBmfrStage->mAccuImages.Filtered, mBmfrStage->mInputs.Motion, &mBmfrStage->mAccuImages.AcceptBools, mBmfrStage->mPrimaryOutput,
+             mBmfrStage->GetFoveationMap()});
 
         for(size_t i = 0; i < images.size(); i++)
         {
@@ -51,7 +57,7 @@ namespace foray::bmfr {
 
         {  // Read Only Images
             std::vector<core::ManagedImage*> readOnlyImages(
-                {&mBmfrStage->mFilterImage, mBmfrStage->mInputs.Motion, &mBmfrStage->mAccuImages.AcceptBools, mBmfrStage->mPrimaryOutput});
+                {&mBmfrStage->mFilterImage, mBmfrStage->mInputs.Motion, &mBmfrStage->mAccuImages.AcceptBools, mBmfrStage->mPrimaryOutput, mBmfrStage->GetFoveationMap()});
 
             for(core::ManagedImage* image : readOnlyImages)
             {
@@ -97,12 +103,13 @@ namespace foray::bmfr {
         mPushC.WriteIdx                                = (renderInfo.GetFrameNumber() + 1) % 2;
         mPushC.EnableHistory                           = mBmfrStage->mHistory.Valid;
         mPushC.DebugMode                               = mBmfrStage->mDebugMode;
+        mPushC.Foveation                               = mBmfrStage->GetFoveationPushConstant();
         mBmfrStage->mAccuImages.LastInputArrayWriteIdx = mPushC.WriteIdx;
         vkCmdPushConstants(cmdBuffer, mPipelineLayout, VkShaderStageFlagBits::VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(mPushC), &mPushC);
 
         VkExtent2D size = renderInfo.GetRenderSize();
 
-        glm::uvec2 localSize(16, 16);
+        glm::uvec2 localSize = mBmfrStage->mTuning.PostProcessLocalSize;
         glm::uvec2 FrameSize(size.width, size.height);
 
         groupSize = glm::uvec3((FrameSize.x + localSize.x - 1) / localSize.x, (FrameSize.y + localSize.y - 1) / localSize.y, 1);
@@ -1,11 +1,12 @@
 #pragma once
 
-#include <stages/foray_computestage.hpp>
+#include "foray_bmfr_computestage.hpp"
+#include "foray_bmfr_foveation.hpp"
 
 namespace foray::bmfr {
     class BmfrDenoiser;
 
-    class PostProcessStage : public foray::stages::ComputeStageBase
+    class PostProcessStage : public BmfrComputeStageBase
     {
       friend BmfrDenoiser;
       public:
@@ -28,9 +29,11 @@ namespace foray::bmfr {
             fp32_t MinNewDataWeight = 0.166666667f;
             uint32_t  EnableHistory;
             uint32_t  DebugMode;
+            FoveationPushConstant Foveation;
         } mPushC;
 
         virtual void ApiInitShader() override;
+        virtual void ApiGetSpecializationConstants(std::vector<uint32_t>& values) override;
         virtual void ApiCreateDescriptorSet() override;
         virtual void ApiCreatePipelineLayout() override;
         virtual void ApiBeforeFrame(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo) override;
@@ -13,6 +13,11 @@ namespace foray::bmfr {
     {
         mShaderKeys.push_back(mShader.CompileFromSource(mContext, BMFR_SHADER_DIR "/preprocess.comp"));
     }
+    void PreProcessStage::ApiGetSpecializationConstants(std::vector<uint32_t>& values)
+    {
+        glm::uvec2 localSize = mBmfrStage->mTuning.PreProcessLocalSize;
+        values               = {localSize.x, localSize.y, (uint32_t)mBmfrStage->mHistoryTileCache};
+    }
     void PreProcessStage::ApiCreateDescriptorSet()
     {
         UpdateDescriptorSet();
@@ -111,7 +116,7 @@ namespace foray::bmfr {
 
         VkExtent2D size = renderInfo.GetRenderSize();
 
-        glm::uvec2 localSize(16, 16);
+        glm::uvec2 localSize = mBmfrStage->mTuning.PreProcessLocalSize;
         glm::uvec2 FrameSize(size.width, size.height);
 
         groupSize = glm::uvec3((FrameSize.x + localSize.x - 1) / localSize.x, (FrameSize.y + localSize.y - 1) / localSize.y, 1);
@@ -1,11 +1,11 @@
 #pragma once
 
-#include <stages/foray_computestage.hpp>
+#include "foray_bmfr_computestage.hpp"
 
 namespace foray::bmfr {
     class BmfrDenoiser;
 
-    class PreProcessStage : public foray::stages::ComputeStageBase
+    class PreProcessStage : public BmfrComputeStageBase
     {
         friend BmfrDenoiser;
       public:
@@ -35,6 +35,7 @@ namespace foray::bmfr {
         } mPushC;
 
         virtual void ApiInitShader() override;
+        virtual void ApiGetSpecializationConstants(std::vector<uint32_t>& values) override;
         virtual void ApiCreateDescriptorSet() override;
         virtual void ApiCreatePipelineLayout() override;
         virtual void ApiBeforeFrame(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo) override;
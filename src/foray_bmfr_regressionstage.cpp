@@ -10,7 +10,8 @@ namespace foray::bmfr {
     void RegressionStage::UpdateDescriptorSet()
     {
         std::vector<core::ManagedImage*> images({mBmfrStage->mInputs.Position, mBmfrStage->mInputs.Normal, mBmfrStage->mInputs.Albedo, &mBmfrStage->mRegression.TempData,
-                                                 &mBmfrStage->mRegression.OutData, &mBmfrStage->mAccuImages.Input, &mBmfrStage->mFilterImage, mBmfrStage->mPrimaryOutput});
+                                                 &mBmfrStage->mRegression.OutData, &mBmfrStage->mAccuImages.Input, &mBmfrStage->mFilterImage, mBmfrStage->mPrimaryOutput,
+                                                 mBmfrStage->GetFoveationMap(), &mBmfrStage->mRegression.TempData32, &mBmfrStage->mRegression.OutData32});
 
         for(size_t i = 0; i < images.size(); i++)
         {
@@ -31,6 +32,14 @@ namespace foray::bmfr {
     {
         mShaderKeys.push_back(mShader.CompileFromSource(mContext, BMFR_SHADER_DIR "/regression.comp"));
     }
+    void RegressionStage::ApiGetSpecializationConstants(std::vector<uint32_t>& values)
+    {
+        const FeatureSet& featureSet = mBmfrStage->mFeatureSet;
+        values = {mBmfrStage->mTuning.RegressionLocalSize,           (VkBool32)featureSet.Has(FeatureSet::Normal),
+                  (VkBool32)featureSet.Has(FeatureSet::Albedo),       (VkBool32)featureSet.Has(FeatureSet::Position),
+                  (VkBool32)featureSet.Has(FeatureSet::PositionSquared), featureSet.BlockEdge,
+                  mBmfrStage->mRegression.Precision};
+    }
     void RegressionStage::ApiCreateDescriptorSet()
     {
         UpdateDescriptorSet();
@@ -46,7 +55,8 @@ namespace foray::bmfr {
         std::vector<VkImageMemoryBarrier2> vkBarriers;
 
         {  // Read Only Images
-            std::vector<core::ManagedImage*> readOnlyImages({mBmfrStage->mInputs.Position, mBmfrStage->mInputs.Normal, mBmfrStage->mInputs.Albedo, mBmfrStage->mPrimaryOutput});
+            std::vector<core::ManagedImage*> readOnlyImages(
+                {mBmfrStage->mInputs.Position, mBmfrStage->mInputs.Normal, mBmfrStage->mInputs.Albedo, mBmfrStage->mPrimaryOutput, mBmfrStage->GetFoveationMap()});
 
             for(core::ManagedImage* image : readOnlyImages)
             {
@@ -61,7 +71,8 @@ namespace foray::bmfr {
             }
         }
         {  // Temp & OutData
-            std::vector<core::ManagedImage*> readWriteImages({&mBmfrStage->mRegression.TempData, &mBmfrStage->mRegression.OutData});
+            std::vector<core::ManagedImage*> readWriteImages({&mBmfrStage->mRegression.TempData, &mBmfrStage->mRegression.OutData, &mBmfrStage->mRegression.TempData32,
+                                                              &mBmfrStage->mRegression.OutData32});
 
             for(core::ManagedImage* image : readWriteImages)
             {
@@ -116,6 +127,7 @@ namespace foray::bmfr {
         mPushC.ReadIdx       = mBmfrStage->mAccuImages.LastInputArrayWriteIdx;
         mPushC.DispatchWidth = dispatch.x;
         mPushC.DebugMode     = mBmfrStage->mDebugMode;
+        mPushC.Foveation     = mBmfrStage->GetFoveationPushConstant();
         vkCmdPushConstants(cmdBuffer, mPipelineLayout, VkShaderStageFlagBits::VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(mPushC), &mPushC);
 
         groupSize = glm::uvec3(dispatch.x * dispatch.y, 1, 1);
@@ -1,12 +1,14 @@
 #pragma once
-#include <stages/foray_computestage.hpp>
+#include "foray_bmfr_computestage.hpp"
+#include "foray_bmfr_foveation.hpp"
 #include "shaders/debug.glsl.h"
 
 namespace foray::bmfr {
     class BmfrDenoiser;
 
-    class RegressionStage : public stages::ComputeStageBase
+    class RegressionStage : public BmfrComputeStageBase
     {
+        friend BmfrDenoiser;
       public:
         void Init(BmfrDenoiser* bmfrStage);
 
@@ -21,9 +23,11 @@ namespace foray::bmfr {
             uint32_t DispatchWidth;
             uint32_t ReadIdx;
             uint32_t DebugMode = DEBUG_NONE;
+            FoveationPushConstant Foveation;
         } mPushC;
 
         virtual void ApiInitShader() override;
+        virtual void ApiGetSpecializationConstants(std::vector<uint32_t>& values) override;
         virtual void ApiCreateDescriptorSet() override;
         virtual void ApiCreatePipelineLayout() override;
         virtual void ApiBeforeFrame(VkCommandBuffer cmdBuffer, base::FrameRenderInfo& renderInfo) override;
@@ -0,0 +1,309 @@
+#include "foray_bmfr_tuning.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace foray::bmfr {
+    void Autotuner::Init(core::Context* context, std::string_view cachePath)
+    {
+        Destroy();
+        mContext   = context;
+        mCachePath = cachePath;
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(mContext->PhysicalDevice(), &properties);
+        mTimestampPeriod = properties.limits.timestampPeriod;
+
+        const VkPhysicalDeviceLimits& limits = properties.limits;
+        mTileCandidates.clear();
+        for(glm::uvec2 candidate : {glm::uvec2(16, 16), glm::uvec2(8, 8), glm::uvec2(32, 8), glm::uvec2(8, 32)})
+        {
+            if(candidate.x * candidate.y <= limits.maxComputeWorkGroupInvocations && candidate.x <= limits.maxComputeWorkGroupSize[0]
+               && candidate.y <= limits.maxComputeWorkGroupSize[1])
+            {
+                mTileCandidates.push_back(candidate);
+            }
+        }
+        mRegressionSupported.clear();
+        for(uint32_t candidate : {256U, 128U, 512U})
+        {
+            if(candidate <= limits.maxComputeWorkGroupInvocations && candidate <= limits.maxComputeWorkGroupSize[0])
+            {
+                mRegressionSupported.push_back(candidate);
+            }
+        }
+
+        VkQueryPoolCreateInfo queryPoolCi{.sType      = VkStructureType::VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                          .queryType  = VkQueryType::VK_QUERY_TYPE_TIMESTAMP,
+                                          .queryCount = SLOT_COUNT * QUERIES_PER_SLOT};
+        AssertVkResult(vkCreateQueryPool(mContext->Device(), &queryPoolCi, nullptr, &mQueryPool));
+    }
+
+    std::string Autotuner::GetCacheKey(const FeatureSet& featureSet)
+    {
+        VkPhysicalDeviceIDProperties idProperties{.sType = VkStructureType::VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES};
+        VkPhysicalDeviceProperties2  properties{.sType = VkStructureType::VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &idProperties};
+        vkGetPhysicalDeviceProperties2(mContext->PhysicalDevice(), &properties);
+
+        std::stringstream key;
+        key << std::hex << std::setfill('0');
+        for(uint8_t byte : idProperties.deviceUUID)
+        {
+            key << std::setw(2) << (uint32_t)byte;
+        }
+        key << std::dec << "-" << properties.properties.driverVersion << "-f" << featureSet.GetFeatureCount() << "-b" << featureSet.BlockEdge;
+        return key.str();
+    }
+
+    std::string Autotuner::GetDefaultCachePath()
+    {
+        std::filesystem::path directory;
+        if(const char* xdgCache = std::getenv("XDG_CACHE_HOME"); !!xdgCache && *xdgCache)
+        {
+            directory = xdgCache;
+        }
+        else if(const char* localAppData = std::getenv("LOCALAPPDATA"); !!localAppData && *localAppData)
+        {
+            directory = localAppData;
+        }
+        else if(const char* home = std::getenv("HOME"); !!home && *home)
+        {
+            directory = std::filesystem::path(home) / ".cache";
+        }
+        else
+        {
+            return "bmfr_tuning.txt";
+        }
+        return (directory / "foray-bmfr" / "tuning.txt").string();
+    }
+
+    bool Autotuner::IsSupported(const TuningConfig& config) const
+    {
+        auto contains = [](const auto& candidates, const auto& value) { return std::find(candidates.begin(), candidates.end(), value) != candidates.end(); };
+        return contains(mTileCandidates, config.PreProcessLocalSize) && contains(mRegressionSupported, config.RegressionLocalSize)
+               && contains(mTileCandidates, config.PostProcessLocalSize);
+    }
+
+    bool Autotuner::LoadCached(TuningConfig& config, const FeatureSet& featureSet)
+    {
+        std::ifstream file(mCachePath);
+        if(!file.is_open())
+        {
+            return false;
+        }
+        std::string deviceKey = GetCacheKey(featureSet);
+        std::string line;
+        while(std::getline(file, line))
+        {
+            std::stringstream stream(line);
+            std::string       key;
+            TuningConfig      entry;
+            stream >> key >> entry.PreProcessLocalSize.x >> entry.PreProcessLocalSize.y >> entry.RegressionLocalSize >> entry.PostProcessLocalSize.x
+                >> entry.PostProcessLocalSize.y;
+            if(!stream.fail() && key == deviceKey)
+            {
+                if(!IsSupported(entry))
+                {  // Zero or unsupported sizes would break dispatch size calculation
+                    logger()->warn("Bmfr tuning cache entry in {} is not supported by the device, ignored", mCachePath);
+                    return false;
+                }
+                config = entry;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Autotuner::StoreCached(const TuningConfig& config)
+    {
+        std::string              deviceKey = GetCacheKey(mFeatureSet);
+        std::vector<std::string> lines;
+        {
+            std::filesystem::path parent = std::filesystem::path(mCachePath).parent_path();
+            std::error_code       error;
+            if(!parent.empty())
+            {
+                std::filesystem::create_directories(parent, error);
+            }
+            std::ifstream file(mCachePath);
+            std::string   line;
+            while(std::getline(file, line))
+            {
+                if(!line.empty() && line.rfind(deviceKey + " ", 0) != 0)
+                {
+                    lines.push_back(line);
+                }
+            }
+        }
+        std::ofstream file(mCachePath, std::ios::trunc);
+        for(const std::string& line : lines)
+        {
+            file << line << "\n";
+        }
+        file << deviceKey << " " << config.PreProcessLocalSize.x << " " << config.PreProcessLocalSize.y << " " << config.RegressionLocalSize << " "
+             << config.PostProcessLocalSize.x << " " << config.PostProcessLocalSize.y << "\n";
+    }
+
+    void Autotuner::Start(const FeatureSet& featureSet, uint32_t regressionMin)
+    {
+        mFeatureSet            = featureSet;
+        uint32_t regressionMax = featureSet.GetBlockSize();
+        mRegressionCandidates.clear();
+        for(uint32_t candidate : mRegressionSupported)
+        {
+            if(candidate >= regressionMin && candidate <= regressionMax)
+            {
+                mRegressionCandidates.push_back(candidate);
+            }
+        }
+        if(mRegressionCandidates.empty())
+        {
+            mRegressionCandidates.push_back(regressionMin);
+        }
+        for(std::vector<Measurement>& measurements : mMeasurements)
+        {
+            measurements.clear();
+        }
+        mMeasurements[(size_t)EStage::PreProcess].resize(mTileCandidates.size());
+        mMeasurements[(size_t)EStage::Regression].resize(mRegressionCandidates.size());
+        mMeasurements[(size_t)EStage::PostProcess].resize(mTileCandidates.size());
+        for(Slot& slot : mSlots)
+        {
+            slot = Slot{};
+        }
+        mStep       = 0;
+        mStepFrames = 0;
+        mStepCount  = (uint32_t)std::max(mTileCandidates.size(), mRegressionCandidates.size());
+        mRunning    = mStepCount > 0;
+    }
+
+    void Autotuner::ApplyCandidates(TuningConfig& config)
+    {
+        // Every candidate is measured exactly once, shorter lists hold their first candidate
+        config.PreProcessLocalSize  = mTileCandidates[mStep < mTileCandidates.size() ? mStep : 0];
+        config.RegressionLocalSize  = mRegressionCandidates[mStep < mRegressionCandidates.size() ? mStep : 0];
+        config.PostProcessLocalSize = mTileCandidates[mStep < mTileCandidates.size() ? mStep : 0];
+    }
+
+    bool Autotuner::BeginFrame(VkCommandBuffer cmdBuffer, uint64_t frameIdx, TuningConfig& config)
+    {
+        uint32_t slotIdx = (uint32_t)(frameIdx % SLOT_COUNT);
+        if(mSlots[slotIdx].Pending)
+        {
+            CollectSlot(slotIdx);
+        }
+
+        if(mStep >= mStepCount)
+        {  // Draining timestamps still in flight
+            for(const Slot& slot : mSlots)
+            {
+                if(slot.Pending)
+                {
+                    return false;
+                }
+            }
+            Finish(config);
+            return true;
+        }
+
+        bool changed = false;
+        if(mStep == 0 && mStepFrames == 0)
+        {
+            ApplyCandidates(config);
+            changed = true;
+        }
+        else if(mStepFrames >= SAMPLE_FRAMES)
+        {
+            mStep++;
+            mStepFrames = 0;
+            if(mStep >= mStepCount)
+            {
+                return false;
+            }
+            ApplyCandidates(config);
+            changed = true;
+        }
+        mStepFrames++;
+
+        vkCmdResetQueryPool(cmdBuffer, mQueryPool, slotIdx * QUERIES_PER_SLOT, QUERIES_PER_SLOT);
+        mSlots[slotIdx] = Slot{.Pending = true, .Step = mStep};
+        return changed;
+    }
+
+    void Autotuner::CmdWriteTimestamp(VkCommandBuffer cmdBuffer, uint64_t frameIdx, EStage stage, bool end)
+    {
+        uint32_t slotIdx = (uint32_t)(frameIdx % SLOT_COUNT);
+        if(!mRunning || !mSlots[slotIdx].Pending)
+        {
+            return;
+        }
+        uint32_t query = slotIdx * QUERIES_PER_SLOT + (uint32_t)stage * 2 + (end ? 1 : 0);
+        vkCmdWriteTimestamp(cmdBuffer, VkPipelineStageFlagBits::VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, mQueryPool, query);
+    }
+
+    void Autotuner::CollectSlot(uint32_t slotIdx)
+    {
+        Slot& slot   = mSlots[slotIdx];
+        slot.Pending = false;
+
+        uint64_t timestamps[QUERIES_PER_SLOT] = {};
+        VkResult result = vkGetQueryPoolResults(mContext->Device(), mQueryPool, slotIdx * QUERIES_PER_SLOT, QUERIES_PER_SLOT, sizeof(timestamps), timestamps,
+                                                sizeof(uint64_t), VkQueryResultFlagBits::VK_QUERY_RESULT_64_BIT);
+        if(result != VkResult::VK_SUCCESS)
+        {  // Not ready (or lost): drop the sample rather than stall
+            return;
+        }
+        for(size_t stage = 0; stage < (size_t)EStage::MaxEnum; stage++)
+        {
+            std::vector<Measurement>& measurements = mMeasurements[stage];
+            if(slot.Step >= measurements.size())
+            {  // Stage is past its candidate list
+                continue;
+            }
+            Measurement& measurement = measurements[slot.Step];
+            measurement.SummedNs += (fp64_t)(timestamps[stage * 2 + 1] - timestamps[stage * 2]) * mTimestampPeriod;
+            measurement.Count++;
+        }
+    }
+
+    void Autotuner::Finish(TuningConfig& config)
+    {
+        auto selectFastest = [](const std::vector<Measurement>& measurements) {
+            size_t best = 0;
+            fp64_t bestNs = 0.0;
+            for(size_t i = 0; i < measurements.size(); i++)
+            {
+                if(measurements[i].Count == 0)
+                {
+                    continue;
+                }
+                fp64_t averageNs = measurements[i].SummedNs / measurements[i].Count;
+                if(bestNs == 0.0 || averageNs < bestNs)
+                {
+                    best   = i;
+                    bestNs = averageNs;
+                }
+            }
+            return best;
+        };
+
+        config.PreProcessLocalSize  = mTileCandidates[selectFastest(mMeasurements[(size_t)EStage::PreProcess])];
+        config.RegressionLocalSize  = mRegressionCandidates[selectFastest(mMeasurements[(size_t)EStage::Regression])];
+        config.PostProcessLocalSize = mTileCandidates[selectFastest(mMeasurements[(size_t)EStage::PostProcess])];
+        StoreCached(config);
+        mRunning = false;
+    }
+
+    void Autotuner::Destroy()
+    {
+        if(!!mQueryPool)
+        {
+            vkDestroyQueryPool(mContext->Device(), mQueryPool, nullptr);
+            mQueryPool = nullptr;
+        }
+        mRunning = false;
+    }
+}  // namespace foray::bmfr
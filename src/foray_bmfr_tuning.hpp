@@ -0,0 +1,103 @@
+#pragma once
+#include "foray_bmfr_featureset.hpp"
+#include <core/foray_context.hpp>
+#include <string>
+#include <vector>
+
+namespace foray::bmfr {
+    /// @brief Workgroup shapes the BMFR shaders are specialized with
+    struct TuningConfig
+    {
+        /// @brief local_size_x/y of preprocess.comp
+        glm::uvec2 PreProcessLocalSize = glm::uvec2(16, 16);
+        /// @brief local_size_x of regression.comp. Power of two, at least BlockSize / 16 and at most the block pixel count of the FeatureSet
+        uint32_t RegressionLocalSize = 256;
+        /// @brief local_size_x/y of postprocess.comp
+        glm::uvec2 PostProcessLocalSize = glm::uvec2(16, 16);
+    };
+
+    /// @brief Benchmarks candidate workgroup shapes on live frames and persists the fastest per device UUID, driver version, feature count and
+    /// block edge (the regression workgroup size limits depend on the feature set)
+    /// @details All three stages are tuned at once, each stepping through its own candidate list. Every candidate runs for SAMPLE_FRAMES frames,
+    /// timed with a dedicated timestamp query pool whose results are read back without waiting. Stages with fewer candidates than others run
+    /// their first candidate unmeasured for the remaining steps.
+    class Autotuner
+    {
+      public:
+        enum class EStage
+        {
+            PreProcess,
+            Regression,
+            PostProcess,
+            MaxEnum
+        };
+
+        void Init(core::Context* context, std::string_view cachePath);
+        void Destroy();
+
+        /// @brief Reads the configuration stored for the current device and feature set. Returns false if there is none, or if it is not one of
+        /// the candidates supported by the device (stale or edited cache)
+        bool LoadCached(TuningConfig& config, const FeatureSet& featureSet);
+
+        /// @brief Per user cache file: $XDG_CACHE_HOME/foray-bmfr/tuning.txt, ~/.cache/foray-bmfr/tuning.txt or %LOCALAPPDATA%\foray-bmfr\tuning.txt.
+        /// Falls back to the working directory if none of these are set
+        static std::string GetDefaultCachePath();
+
+        /// @brief Starts tuning for a feature set. The caller keeps using the configuration written by BeginFrame(...)
+        /// @param regressionMin Smallest regression workgroup size the feature set allows. The largest is its block pixel count
+        void Start(const FeatureSet& featureSet, uint32_t regressionMin);
+        inline bool IsRunning() const { return mRunning; }
+
+        /// @brief Collects finished timings and selects the configuration to record with this frame
+        /// @return True if the configuration changed and pipelines have to be rebuilt
+        bool BeginFrame(VkCommandBuffer cmdBuffer, uint64_t frameIdx, TuningConfig& config);
+        void CmdWriteTimestamp(VkCommandBuffer cmdBuffer, uint64_t frameIdx, EStage stage, bool end);
+
+        inline static const uint32_t SAMPLE_FRAMES = 32;
+
+      protected:
+        void CollectSlot(uint32_t slot);
+        void Finish(TuningConfig& config);
+        void ApplyCandidates(TuningConfig& config);
+        bool IsSupported(const TuningConfig& config) const;
+        void StoreCached(const TuningConfig& config);
+        /// @brief Device UUID, driver version, feature count and block edge. Contains no whitespace
+        std::string GetCacheKey(const FeatureSet& featureSet);
+
+        /// @brief Timestamp query sets kept in flight, indexed by frame number
+        inline static const uint32_t SLOT_COUNT = 8;
+        inline static const uint32_t QUERIES_PER_SLOT = (uint32_t)EStage::MaxEnum * 2;
+
+        core::Context* mContext = nullptr;
+        std::string    mCachePath;
+        /// @brief Feature set of the running tuning
+        FeatureSet     mFeatureSet;
+        VkQueryPool    mQueryPool = nullptr;
+        fp32_t         mTimestampPeriod = 1.f;
+
+        std::vector<glm::uvec2> mTileCandidates;
+        /// @brief Regression workgroup sizes within device limits
+        std::vector<uint32_t>   mRegressionSupported;
+        /// @brief Regression workgroup sizes within device limits and the limits of the feature set
+        std::vector<uint32_t>   mRegressionCandidates;
+
+        struct Measurement
+        {
+            fp64_t   SummedNs = 0.0;
+            uint32_t Count    = 0;
+        };
+        /// @brief Per stage: one entry per candidate
+        std::vector<Measurement> mMeasurements[(size_t)EStage::MaxEnum];
+
+        struct Slot
+        {
+            bool     Pending = false;
+            uint32_t Step    = 0;
+        } mSlots[SLOT_COUNT];
+
+        bool     mRunning = false;
+        uint32_t mStep    = 0;
+        uint32_t mStepFrames = 0;
+        uint32_t mStepCount  = 0;
+    };
+}  // namespace foray::bmfr
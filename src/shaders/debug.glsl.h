@@ -15,6 +15,9 @@ namespace foray::bmfr
     const uint DEBUG_REGRESSION_BLOCKS = 5U;
     const uint DEBUG_POSTPROCESS_ACCEPTS = 6U;
     const uint DEBUG_POSTPROCESS_ALPHA = 7U;
+    const uint DEBUG_FOVEATION_QUALITY = 8U;
+    // Share of a block's features the regression discarded as degenerate
+    const uint DEBUG_REGRESSION_DEGENERATE = 9U;
 #ifdef __cplusplus
 } // namespace foray::bmfr
 #endif
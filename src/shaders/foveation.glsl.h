@@ -0,0 +1,28 @@
+#ifndef BMFRFOVEATION_GLSL
+#define BMFRFOVEATION_GLSL
+#ifdef __cplusplus
+#pragma once
+
+namespace foray::bmfr
+{
+    using uint = unsigned int;
+#endif
+    const uint FOVEATION_OFF = 0U;
+    // Quality falls off with distance to a gaze point
+    const uint FOVEATION_GAZE = 1U;
+    // Quality is read from a r8 foveation map (1 = full quality)
+    const uint FOVEATION_MAP = 2U;
+#ifdef __cplusplus
+} // namespace foray::bmfr
+#else
+
+// Quality [0...1] of a texel. Radii are relative to render height, so the foveal region stays round
+float foveationQualityFromGaze(in vec2 texel, in vec2 renderSize, in vec2 gaze, in float innerRadius, in float outerRadius)
+{
+    vec2 offset = (texel / renderSize - gaze) * vec2(renderSize.x / renderSize.y, 1.f);
+    return 1.f - smoothstep(innerRadius, outerRadius, length(offset));
+}
+
+#endif
+
+#endif // BMFRFOVEATION_GLSL
@@ -0,0 +1,81 @@
+#ifndef HISTORYTILE_GLSL
+#define HISTORYTILE_GLSL
+
+// Shared memory cache of the history texels a workgroup reprojects from.
+// With coherent motion the bilinear footprints of a workgroup cover its own tile shifted by motion plus a one texel apron, so loading that
+// region once replaces 4 scattered loads per invocation and image. HISTORY_TILE_SLACK texels of extra margin tolerate slightly diverging
+// motion. If the footprint is larger than the tile, the workgroup falls back to direct image loads. Samples outside the tile (e.g. rounding
+// at the tile border) are always loaded directly.
+
+// Requires constant_id 0 and 1 to be used for local_size_x_id / local_size_y_id
+layout(constant_id = 2) const bool HISTORY_TILE_CACHE = true;
+
+const uint HISTORY_TILE_SLACK  = 2;
+const uint HISTORY_TILE_WIDTH  = gl_WorkGroupSize.x + 1 + HISTORY_TILE_SLACK;
+const uint HISTORY_TILE_HEIGHT = gl_WorkGroupSize.y + 1 + HISTORY_TILE_SLACK;
+// Shared arrays shrink to a single element if the cache is disabled
+const uint HISTORY_TILE_SIZE   = HISTORY_TILE_CACHE ? HISTORY_TILE_WIDTH * HISTORY_TILE_HEIGHT : 1;
+
+shared int HistoryTileMinX;
+shared int HistoryTileMinY;
+shared int HistoryTileMaxX;
+shared int HistoryTileMaxY;
+
+// Finds the bounds of the workgroup's reprojected sample positions. Must be called in uniform control flow.
+// Returns true if the footprint fits the tile, tileOrigin is the texel stored at tile index 0. Returns false if no invocation participates.
+bool historyTileSetup(in ivec2 sampleBase, in bool participate, out ivec2 tileOrigin)
+{
+    if (gl_LocalInvocationIndex == 0)
+    {
+        HistoryTileMinX = 0x7FFFFFFF;
+        HistoryTileMinY = 0x7FFFFFFF;
+        HistoryTileMaxX = -0x7FFFFFFF;
+        HistoryTileMaxY = -0x7FFFFFFF;
+    }
+    memoryBarrierShared();
+    barrier();
+    if (participate)
+    {
+        atomicMin(HistoryTileMinX, sampleBase.x);
+        atomicMin(HistoryTileMinY, sampleBase.y);
+        atomicMax(HistoryTileMaxX, sampleBase.x);
+        atomicMax(HistoryTileMaxY, sampleBase.y);
+    }
+    memoryBarrierShared();
+    barrier();
+
+    tileOrigin = ivec2(HistoryTileMinX, HistoryTileMinY);
+    // Sample bases plus the bilinear neighbour at +1 have to fit
+    ivec2 footprint = ivec2(HistoryTileMaxX, HistoryTileMaxY) - tileOrigin + ivec2(2);
+    return HistoryTileMinX <= HistoryTileMaxX && footprint.x <= int(HISTORY_TILE_WIDTH) && footprint.y <= int(HISTORY_TILE_HEIGHT);
+}
+
+ivec2 historyTileTexel(in uint tileIndex, in ivec2 tileOrigin)
+{
+    return tileOrigin + ivec2(tileIndex % HISTORY_TILE_WIDTH, tileIndex / HISTORY_TILE_WIDTH);
+}
+
+// Tile index of a sample position, -1 if the tile does not contain it
+int historyTileIndex(in ivec2 samplePos, in ivec2 tileOrigin)
+{
+    ivec2 local = samplePos - tileOrigin;
+    if (local.x < 0 || local.y < 0 || local.x >= int(HISTORY_TILE_WIDTH) || local.y >= int(HISTORY_TILE_HEIGHT))
+    {
+        return -1;
+    }
+    return local.y * int(HISTORY_TILE_WIDTH) + local.x;
+}
+
+// For the accumulated color only: it is stored as rgba16f, so packing to half floats is lossless and halves shared memory use.
+// Position and normal history have the input formats (usually fp32) and must not be packed
+uvec2 packHistoryTexel(in vec4 value)
+{
+    return uvec2(packHalf2x16(value.xy), packHalf2x16(value.zw));
+}
+
+vec4 unpackHistoryTexel(in uvec2 value)
+{
+    return vec4(unpackHalf2x16(value.x), unpackHalf2x16(value.y));
+}
+
+#endif // HISTORYTILE_GLSL
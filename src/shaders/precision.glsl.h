@@ -0,0 +1,22 @@
+#ifndef BMFRPRECISION_GLSL
+#define BMFRPRECISION_GLSL
+#ifdef __cplusplus
+#pragma once
+
+namespace foray::bmfr
+{
+    using uint = unsigned int;
+#endif
+    // Storage precision of the regression scratch images. Reductions and the R matrix are always fp32
+    // regression.comp declares the r16f and r8 images for every precision, so all of them need shaderStorageImageExtendedFormats
+    // r16f images, 2 bytes per value
+    const uint SCRATCH_FP16 = 0U;
+    // r32ui images holding fp32 bit patterns, 4 bytes per value
+    const uint SCRATCH_FP32 = 1U;
+    // r32ui images holding two rows of a pixel as packed halfs, 2 bytes per value
+    const uint SCRATCH_FP16X2 = 2U;
+#ifdef __cplusplus
+} // namespace foray::bmfr
+#endif
+
+#endif // BMFRPRECISION_GLSL
@@ -0,0 +1,188 @@
+#include "foray_bmfr_offline_runner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <glm/gtc/packing.hpp>
+
+namespace foray::bmfr::offline {
+    void OfflineRunner::ComparePrecisions(const std::string& capturePath)
+    {
+        CreateDevice();
+
+        CaptureReplayer replayer;
+        replayer.Open(&mContext, capturePath);
+        const capture::FileHeader& header = replayer.GetHeader();
+        VkFormat                   format = header.OutputFormat;
+        Assert(format == VkFormat::VK_FORMAT_R16G16B16A16_SFLOAT || format == VkFormat::VK_FORMAT_R32G32B32A32_SFLOAT,
+               "Bmfr precision comparison supports rgba16f and rgba32f outputs");
+        mExtent = VkExtent2D{header.Width, header.Height};
+        mDenoiser.Init(&mContext, replayer);
+
+        size_t outputSize = (size_t)mExtent.width * mExtent.height * capture::GetTexelSize(format);
+        Slot&  slot       = mSlots.emplace_back();
+        {
+            VkCommandBufferAllocateInfo cmdAllocInfo{.sType              = VkStructureType::VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                                                     .commandPool        = mCommandPool,
+                                                     .level              = VkCommandBufferLevel::VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                                     .commandBufferCount = 1U};
+            AssertVkResult(vkAllocateCommandBuffers(mContext.Device(), &cmdAllocInfo, &slot.CommandBuffer));
+
+            VkFenceCreateInfo fenceCi{.sType = VkStructureType::VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+            AssertVkResult(vkCreateFence(mContext.Device(), &fenceCi, nullptr, &slot.Fence));
+
+            VkBufferCreateInfo      bufferCi{.sType = VkStructureType::VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                             .size  = outputSize,
+                                             .usage = VkBufferUsageFlagBits::VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+            VmaAllocationCreateInfo allocCi{.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, .usage = VMA_MEMORY_USAGE_AUTO};
+            VmaAllocationInfo       allocInfo{};
+            AssertVkResult(vmaCreateBuffer(mContext.Allocator, &bufferCi, &allocCi, &slot.Readback, &slot.ReadbackAlloc, &allocInfo));
+            slot.ReadbackData = (uint8_t*)allocInfo.pMappedData;
+
+            VkQueryPoolCreateInfo queryPoolCi{
+                .sType = VkStructureType::VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, .queryType = VkQueryType::VK_QUERY_TYPE_TIMESTAMP, .queryCount = 2U};
+            AssertVkResult(vkCreateQueryPool(mContext.Device(), &queryPoolCi, nullptr, &mQueryPool));
+        }
+
+        auto readValue = [format](const uint8_t* data, size_t value) -> fp64_t {
+            if(format == VkFormat::VK_FORMAT_R32G32B32A32_SFLOAT)
+            {
+                return ((const fp32_t*)data)[value];
+            }
+            return glm::unpackHalf1x16(((const uint16_t*)data)[value]);
+        };
+
+        // The fp32 pass runs first and is the reference. Its outputs are spilled to disk, captures do not fit in memory
+        const uint32_t       precisions[]    = {SCRATCH_FP32, SCRATCH_FP16, SCRATCH_FP16X2};
+        const char*          names[]         = {"fp32", "fp16", "fp16x2"};
+        const uint32_t       bytesPerValue[] = {4U, 2U, 2U};
+        const std::string    referencePath   = capturePath + ".reference.tmp";
+        std::vector<uint8_t> reference(outputSize);
+        fp64_t               referenceMs = 0.0;
+        for(size_t p = 0; p < sizeof(precisions) / sizeof(uint32_t); p++)
+        {
+            bool         isReference = p == 0;
+            std::fstream referenceFile(referencePath, isReference ? std::ios::out | std::ios::binary | std::ios::trunc : std::ios::in | std::ios::binary);
+            Assert(referenceFile.is_open(), "Bmfr precision comparison could not open the reference output file");
+
+            // Every pass starts from the same history
+            mDenoiser.SetRegressionPrecision(precisions[p]);
+            mDenoiser.IgnoreHistoryNextFrame();
+
+            fp64_t   totalMs    = 0.0;
+            fp64_t   sumSquared = 0.0;
+            fp64_t   maxError   = 0.0;
+            uint64_t valueCount = 0;
+            uint64_t nonFinite  = 0;
+            for(uint32_t index = 0; index < replayer.GetFrameCount(); index++)
+            {
+                totalMs += ReplayFrame(slot, replayer, index);
+                if(isReference)
+                {
+                    referenceFile.write((const char*)slot.ReadbackData, (std::streamsize)outputSize);
+                    Assert(!!referenceFile, "Bmfr precision comparison could not write the reference output");
+                    continue;
+                }
+                referenceFile.read((char*)reference.data(), (std::streamsize)outputSize);
+                Assert(!!referenceFile, "Bmfr precision comparison reference output is truncated");
+                for(size_t value = 0; value < (size_t)mExtent.width * mExtent.height * 4; value++)
+                {
+                    if(value % 4 == 3)
+                    {  // Alpha is not denoised
+                        continue;
+                    }
+                    fp64_t error = std::abs(readValue(slot.ReadbackData, value) - readValue(reference.data(), value));
+                    if(!std::isfinite(error))
+                    {
+                        nonFinite++;
+                        continue;
+                    }
+                    sumSquared += error * error;
+                    maxError = std::max(maxError, error);
+                    valueCount++;
+                }
+            }
+
+            // GPU time includes the input upload, which is the same for every precision
+            fp64_t frameMs = totalMs / std::max(replayer.GetFrameCount(), 1U);
+            if(isReference)
+            {
+                referenceMs = frameMs;
+                logger()->info("Bmfr precision {}: {} bytes per scratch value, {:.3f} ms per frame (reference)", names[p], bytesPerValue[p], frameMs);
+                continue;
+            }
+            fp64_t rmse = valueCount > 0 ? std::sqrt(sumSquared / valueCount) : 0.0;
+            logger()->info("Bmfr precision {}: {} bytes per scratch value, {:.3f} ms per frame ({:+.1f}%), RMSE {:.6f}, max error {:.6f}, {} non-finite values",
+                           names[p], bytesPerValue[p], frameMs, referenceMs > 0.0 ? (frameMs / referenceMs - 1.0) * 100.0 : 0.0, rmse, maxError, nonFinite);
+        }
+        std::filesystem::remove(referencePath);
+
+        AssertVkResult(vkDeviceWaitIdle(mContext.Device()));
+        vkDestroyQueryPool(mContext.Device(), mQueryPool, nullptr);
+        mQueryPool = nullptr;
+        vmaDestroyBuffer(mContext.Allocator, slot.Readback, slot.ReadbackAlloc);
+        vkDestroyFence(mContext.Device(), slot.Fence, nullptr);
+        vkFreeCommandBuffers(mContext.Device(), mCommandPool, 1U, &slot.CommandBuffer);
+        mSlots.clear();
+        mDenoiser.Destroy();
+        replayer.Destroy();
+        DestroyDevice();
+    }
+
+    fp64_t OfflineRunner::ReplayFrame(Slot& slot, CaptureReplayer& replayer, uint32_t index)
+    {
+        VkCommandBuffer cmdBuffer = slot.CommandBuffer;
+
+        VkCommandBufferBeginInfo beginInfo{.sType = VkStructureType::VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                           .flags = VkCommandBufferUsageFlagBits::VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+        AssertVkResult(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+
+        vkCmdResetQueryPool(cmdBuffer, mQueryPool, 0U, 2U);
+        vkCmdWriteTimestamp2(cmdBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, mQueryPool, 0U);
+        mDenoiser.RecordReplayFrame(cmdBuffer, replayer, index);
+        vkCmdWriteTimestamp2(cmdBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, mQueryPool, 1U);
+
+        {  // Read back output. RecordReplayFrame leaves it in VK_IMAGE_LAYOUT_GENERAL, which the next replayed frame expects again
+            core::ManagedImage*   output = replayer.GetOutput();
+            VkImageMemoryBarrier2 vkBarrier{.sType            = VkStructureType::VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                                            .srcStageMask     = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                            .srcAccessMask    = VK_ACCESS_2_MEMORY_WRITE_BIT,
+                                            .dstStageMask     = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                            .dstAccessMask    = VK_ACCESS_2_TRANSFER_READ_BIT,
+                                            .oldLayout        = VkImageLayout::VK_IMAGE_LAYOUT_GENERAL,
+                                            .newLayout        = VkImageLayout::VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                            .image            = output->GetImage(),
+                                            .subresourceRange = VkImageSubresourceRange{.aspectMask = VkImageAspectFlagBits::VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1U, .layerCount = 1U}};
+            VkDependencyInfo      depInfo{.sType = VkStructureType::VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = 1U, .pImageMemoryBarriers = &vkBarrier};
+            vkCmdPipelineBarrier2(cmdBuffer, &depInfo);
+
+            VkBufferImageCopy region{.imageSubresource = VkImageSubresourceLayers{.aspectMask = VkImageAspectFlagBits::VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1U},
+                                     .imageExtent      = VkExtent3D{mExtent.width, mExtent.height, 1U}};
+            vkCmdCopyImageToBuffer(cmdBuffer, output->GetImage(), VkImageLayout::VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.Readback, 1U, &region);
+
+            vkBarrier.srcStageMask  = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+            vkBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+            vkBarrier.dstStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            vkBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+            vkBarrier.oldLayout     = VkImageLayout::VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            vkBarrier.newLayout     = VkImageLayout::VK_IMAGE_LAYOUT_GENERAL;
+            vkCmdPipelineBarrier2(cmdBuffer, &depInfo);
+        }
+
+        AssertVkResult(vkEndCommandBuffer(cmdBuffer));
+
+        VkCommandBufferSubmitInfo cmdSubmitInfo{.sType = VkStructureType::VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, .commandBuffer = cmdBuffer};
+        VkSubmitInfo2             submitInfo{.sType = VkStructureType::VK_STRUCTURE_TYPE_SUBMIT_INFO_2, .commandBufferInfoCount = 1U, .pCommandBufferInfos = &cmdSubmitInfo};
+        AssertVkResult(vkQueueSubmit2(mQueue, 1U, &submitInfo, slot.Fence));
+        AssertVkResult(vkWaitForFences(mContext.Device(), 1U, &slot.Fence, VK_TRUE, UINT64_MAX));
+        AssertVkResult(vkResetFences(mContext.Device(), 1U, &slot.Fence));
+        AssertVkResult(vmaInvalidateAllocation(mContext.Allocator, slot.ReadbackAlloc, 0, VK_WHOLE_SIZE));
+
+        uint64_t timestamps[2]{};
+        AssertVkResult(vkGetQueryPoolResults(mContext.Device(), mQueryPool, 0U, 2U, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                                             VkQueryResultFlagBits::VK_QUERY_RESULT_64_BIT | VkQueryResultFlagBits::VK_QUERY_RESULT_WAIT_BIT));
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(mContext.PhysicalDevice(), &properties);
+        return (fp64_t)(timestamps[1] - timestamps[0]) * properties.limits.timestampPeriod / 1000000.0;
+    }
+}  // namespace foray::bmfr::offline
@@ -0,0 +1,291 @@
+#include "foray_bmfr_offline_runner.hpp"
+#include <chrono>
+#include <cstring>
+
+namespace foray::bmfr::offline {
+    void OfflineRunner::Run(const Options& options)
+    {
+        mOptions = options;
+        mInfo    = SequenceInfo::Load(mOptions.InputDir);
+        mExtent  = VkExtent2D{mInfo.Width, mInfo.Height};
+
+        CreateDevice();
+        CreateResources();
+
+        {
+            FrameWriter     writer(mOptions.OutputDir, mOptions.InFlightFrames + 2);
+            FramePrefetcher prefetcher(mOptions.InputDir, mInfo, mOptions.PrefetchFrames);
+
+            auto     start       = std::chrono::steady_clock::now();
+            uint64_t frameNumber = 0;
+            while(std::optional<MappedFrame> frame = prefetcher.Next())
+            {
+                Slot& slot = mSlots[frameNumber % mSlots.size()];
+                Complete(slot, writer);
+                Upload(slot, *frame);
+                RecordAndSubmit(slot, *frame, frameNumber);
+                frameNumber++;
+                if(frameNumber % 100 == 0)
+                {
+                    fp64_t seconds = std::chrono::duration<fp64_t>(std::chrono::steady_clock::now() - start).count();
+                    logger()->info("Bmfr offline: {} frames, {:.2f} fps", frameNumber, frameNumber / seconds);
+                }
+            }
+            for(size_t i = 0; i < mSlots.size(); i++)
+            {  // Drain in submission order, so frames are written in order
+                Complete(mSlots[(frameNumber + i) % mSlots.size()], writer);
+            }
+            writer.Finish();
+            fp64_t seconds = std::chrono::duration<fp64_t>(std::chrono::steady_clock::now() - start).count();
+            logger()->info("Bmfr offline: denoised {} frames in {:.2f}s ({:.2f} fps)", frameNumber, seconds, frameNumber / seconds);
+        }
+
+        DestroyResources();
+        DestroyDevice();
+    }
+
+    void OfflineRunner::CreateDevice()
+    {
+        // No window is created, so the device is selected without presentation support (lavapipe works)
+        mInstance.Create();
+        mDevice.SetEnableDefaultFeaturesAndExtensions(false);
+        mDevice.Create();
+
+        // vkb::QueueType::compute only resolves dedicated compute families (without the graphics bit). Software rasterizers such as lavapipe
+        // expose a single graphics + compute family, so the first family with compute support is used instead
+        vkb::Device& vkbDevice = *mContext.VkbDevice;
+        bool         found     = false;
+        for(uint32_t family = 0; family < (uint32_t)vkbDevice.queue_families.size(); family++)
+        {
+            if((vkbDevice.queue_families[family].queueFlags & VkQueueFlagBits::VK_QUEUE_COMPUTE_BIT) > 0)
+            {
+                mQueueFamilyIndex = family;
+                found             = true;
+                break;
+            }
+        }
+        Assert(found, "Bmfr offline: device has no compute queue family");
+        // vk-bootstrap creates one queue per family unless told otherwise
+        vkGetDeviceQueue(mContext.Device(), mQueueFamilyIndex, 0U, &mQueue);
+
+        VmaAllocatorCreateInfo allocatorCi{.physicalDevice   = mContext.PhysicalDevice(),
+                                           .device           = mContext.Device(),
+                                           .instance         = mContext.Instance(),
+                                           .vulkanApiVersion = VK_API_VERSION_1_3};
+        AssertVkResult(vmaCreateAllocator(&allocatorCi, &mContext.Allocator));
+
+        VkCommandPoolCreateInfo poolCi{.sType            = VkStructureType::VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                                       .flags            = VkCommandPoolCreateFlagBits::VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                                       .queueFamilyIndex = mQueueFamilyIndex};
+        AssertVkResult(vkCreateCommandPool(mContext.Device(), &poolCi, nullptr, &mCommandPool));
+    }
+
+    void OfflineRunner::ConfigurePhysicalDeviceSelector(vkb::PhysicalDeviceSelector& selector)
+    {
+        // rgba16f/rg16f/r16f/r8 storage images
+        VkPhysicalDeviceFeatures features{.shaderStorageImageExtendedFormats = VK_TRUE};
+        // vkCmdPipelineBarrier2, vkQueueSubmit2
+        VkPhysicalDeviceVulkan13Features features13{.sType = VkStructureType::VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES, .synchronization2 = VK_TRUE};
+        selector.set_minimum_version(1, 3);
+        selector.require_present(false);
+        selector.set_required_features(features);
+        selector.set_required_features_13(features13);
+    }
+
+    void OfflineRunner::CreateResources()
+    {
+        VkImageUsageFlags inputUsage = VkImageUsageFlagBits::VK_IMAGE_USAGE_STORAGE_BIT | VkImageUsageFlagBits::VK_IMAGE_USAGE_TRANSFER_DST_BIT
+                                       | VkImageUsageFlagBits::VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        for(size_t channel = 0; channel < (size_t)EChannel::MaxEnum; channel++)
+        {
+            VkFormat format = (EChannel)channel == EChannel::Motion ? VkFormat::VK_FORMAT_R16G16_SFLOAT : VkFormat::VK_FORMAT_R16G16B16A16_SFLOAT;
+            std::string name = std::string("Bmfr.Offline.") + SequenceInfo::GetChannelName((EChannel)channel);
+            core::ManagedImage::CreateInfo ci(inputUsage, format, mExtent, name);
+            mInputs[channel].Create(&mContext, ci);
+        }
+        {
+            VkImageUsageFlags usage = VkImageUsageFlagBits::VK_IMAGE_USAGE_STORAGE_BIT | VkImageUsageFlagBits::VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            core::ManagedImage::CreateInfo ci(usage, VkFormat::VK_FORMAT_R16G16B16A16_SFLOAT, mExtent, "Bmfr.Offline.Output");
+            mOutput.Create(&mContext, ci);
+        }
+
+        stages::DenoiserConfig config;
+        config.PrimaryInput                                                    = &mInputs[(size_t)EChannel::Primary];
+        config.PrimaryOutput                                                   = &mOutput;
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Position] = &mInputs[(size_t)EChannel::Position];
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Normal]   = &mInputs[(size_t)EChannel::Normal];
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Albedo]   = &mInputs[(size_t)EChannel::Albedo];
+        config.GBufferOutputs[(size_t)stages::GBufferStage::EOutput::Motion]   = &mInputs[(size_t)EChannel::Motion];
+        mDenoiser.Init(&mContext, config);
+
+        size_t stagingSize = 0;
+        for(size_t channel = 0; channel < (size_t)EChannel::MaxEnum; channel++)
+        {
+            stagingSize += mInfo.GetChannelSize((EChannel)channel);
+        }
+        size_t readbackSize = (size_t)mExtent.width * mExtent.height * 4 * sizeof(uint16_t);
+
+        mSlots.resize(std::max(mOptions.InFlightFrames, 1U));
+        for(Slot& slot : mSlots)
+        {
+            VkCommandBufferAllocateInfo cmdAllocInfo{.sType              = VkStructureType::VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                                                     .commandPool        = mCommandPool,
+                                                     .level              = VkCommandBufferLevel::VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                                     .commandBufferCount = 1U};
+            AssertVkResult(vkAllocateCommandBuffers(mContext.Device(), &cmdAllocInfo, &slot.CommandBuffer));
+
+            VkFenceCreateInfo fenceCi{.sType = VkStructureType::VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+            AssertVkResult(vkCreateFence(mContext.Device(), &fenceCi, nullptr, &slot.Fence));
+
+            VmaAllocationInfo allocInfo{};
+            {  // Staging
+                VkBufferCreateInfo      bufferCi{.sType = VkStructureType::VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                                 .size  = stagingSize,
+                                                 .usage = VkBufferUsageFlagBits::VK_BUFFER_USAGE_TRANSFER_SRC_BIT};
+                VmaAllocationCreateInfo allocCi{.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                                .usage = VMA_MEMORY_USAGE_AUTO};
+                AssertVkResult(vmaCreateBuffer(mContext.Allocator, &bufferCi, &allocCi, &slot.Staging, &slot.StagingAlloc, &allocInfo));
+                slot.StagingData = (uint8_t*)allocInfo.pMappedData;
+            }
+            {  // Readback
+                VkBufferCreateInfo      bufferCi{.sType = VkStructureType::VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                                 .size  = readbackSize,
+                                                 .usage = VkBufferUsageFlagBits::VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+                VmaAllocationCreateInfo allocCi{.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                                .usage = VMA_MEMORY_USAGE_AUTO};
+                AssertVkResult(vmaCreateBuffer(mContext.Allocator, &bufferCi, &allocCi, &slot.Readback, &slot.ReadbackAlloc, &allocInfo));
+                slot.ReadbackData = (uint8_t*)allocInfo.pMappedData;
+            }
+        }
+    }
+
+    void OfflineRunner::Upload(Slot& slot, const MappedFrame& frame)
+    {
+        size_t offset = 0;
+        for(size_t channel = 0; channel < (size_t)EChannel::MaxEnum; channel++)
+        {
+            const MappedFile& file = frame.Channels[channel];
+            std::memcpy(slot.StagingData + offset, file.GetData(), file.GetSize());
+            offset += file.GetSize();
+        }
+        AssertVkResult(vmaFlushAllocation(mContext.Allocator, slot.StagingAlloc, 0, VK_WHOLE_SIZE));
+    }
+
+    void OfflineRunner::RecordAndSubmit(Slot& slot, const MappedFrame& frame, uint64_t frameNumber)
+    {
+        VkCommandBuffer cmdBuffer = slot.CommandBuffer;
+
+        VkCommandBufferBeginInfo beginInfo{.sType = VkStructureType::VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                           .flags = VkCommandBufferUsageFlagBits::VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+        AssertVkResult(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+
+        base::FrameRenderInfo renderInfo;
+        renderInfo.SetFrameNumber(frameNumber);
+        renderInfo.SetRenderSize(mExtent);
+
+        {  // Upload inputs. Contents of the previous frame are overwritten entirely, so the old layout is discarded. The barrier orders the copy after
+           // the reads of previously submitted frames, all slots share these images
+            std::vector<VkImageMemoryBarrier2> vkBarriers;
+            for(core::ManagedImage& image : mInputs)
+            {
+                core::ImageLayoutCache::Barrier2 barrier{
+                    .SrcStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                    .SrcAccessMask = VK_ACCESS_2_MEMORY_READ_BIT,
+                    .DstStageMask  = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                    .DstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                    .NewLayout     = VkImageLayout::VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                };
+                vkBarriers.push_back(renderInfo.GetImageLayoutCache().MakeBarrier(image, barrier));
+            }
+            VkDependencyInfo depInfo{.sType                   = VkStructureType::VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                                     .imageMemoryBarrierCount = (uint32_t)vkBarriers.size(),
+                                     .pImageMemoryBarriers    = vkBarriers.data()};
+            vkCmdPipelineBarrier2(cmdBuffer, &depInfo);
+
+            VkDeviceSize offset = 0;
+            for(size_t channel = 0; channel < (size_t)EChannel::MaxEnum; channel++)
+            {
+                VkBufferImageCopy region{.bufferOffset     = offset,
+                                         .imageSubresource = VkImageSubresourceLayers{.aspectMask = VkImageAspectFlagBits::VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1U},
+                                         .imageExtent      = VkExtent3D{mExtent.width, mExtent.height, 1U}};
+                vkCmdCopyBufferToImage(cmdBuffer, slot.Staging, mInputs[channel].GetImage(), VkImageLayout::VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1U, &region);
+                offset += mInfo.GetChannelSize((EChannel)channel);
+            }
+        }
+
+        if(frame.Cut)
+        {
+            mDenoiser.IgnoreHistoryNextFrame();
+        }
+        mDenoiser.RecordFrame(cmdBuffer, renderInfo);
+
+        {  // Read back output
+            core::ImageLayoutCache::Barrier2 barrier{
+                .SrcStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                .SrcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+                .DstStageMask  = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                .DstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+                .NewLayout     = VkImageLayout::VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            };
+            VkImageMemoryBarrier2 vkBarrier = renderInfo.GetImageLayoutCache().MakeBarrier(mOutput, barrier);
+            VkDependencyInfo      depInfo{.sType = VkStructureType::VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = 1U, .pImageMemoryBarriers = &vkBarrier};
+            vkCmdPipelineBarrier2(cmdBuffer, &depInfo);
+
+            VkBufferImageCopy region{.imageSubresource = VkImageSubresourceLayers{.aspectMask = VkImageAspectFlagBits::VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1U},
+                                     .imageExtent      = VkExtent3D{mExtent.width, mExtent.height, 1U}};
+            vkCmdCopyImageToBuffer(cmdBuffer, mOutput.GetImage(), VkImageLayout::VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.Readback, 1U, &region);
+        }
+
+        AssertVkResult(vkEndCommandBuffer(cmdBuffer));
+
+        VkCommandBufferSubmitInfo cmdSubmitInfo{.sType = VkStructureType::VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, .commandBuffer = cmdBuffer};
+        VkSubmitInfo2             submitInfo{.sType = VkStructureType::VK_STRUCTURE_TYPE_SUBMIT_INFO_2, .commandBufferInfoCount = 1U, .pCommandBufferInfos = &cmdSubmitInfo};
+        AssertVkResult(vkQueueSubmit2(mQueue, 1U, &submitInfo, slot.Fence));
+
+        slot.Pending  = true;
+        slot.FrameIdx = frame.Index;
+    }
+
+    void OfflineRunner::Complete(Slot& slot, FrameWriter& writer)
+    {
+        if(!slot.Pending)
+        {
+            return;
+        }
+        AssertVkResult(vkWaitForFences(mContext.Device(), 1U, &slot.Fence, VK_TRUE, UINT64_MAX));
+        AssertVkResult(vkResetFences(mContext.Device(), 1U, &slot.Fence));
+        AssertVkResult(vmaInvalidateAllocation(mContext.Allocator, slot.ReadbackAlloc, 0, VK_WHOLE_SIZE));
+
+        size_t size = (size_t)mExtent.width * mExtent.height * 4 * sizeof(uint16_t);
+        writer.Write(slot.FrameIdx, std::vector<uint8_t>(slot.ReadbackData, slot.ReadbackData + size));
+        slot.Pending = false;
+    }
+
+    void OfflineRunner::DestroyResources()
+    {
+        AssertVkResult(vkDeviceWaitIdle(mContext.Device()));
+        for(Slot& slot : mSlots)
+        {
+            vmaDestroyBuffer(mContext.Allocator, slot.Staging, slot.StagingAlloc);
+            vmaDestroyBuffer(mContext.Allocator, slot.Readback, slot.ReadbackAlloc);
+            vkDestroyFence(mContext.Device(), slot.Fence, nullptr);
+            vkFreeCommandBuffers(mContext.Device(), mCommandPool, 1U, &slot.CommandBuffer);
+        }
+        mSlots.clear();
+        mDenoiser.Destroy();
+        for(core::ManagedImage& image : mInputs)
+        {
+            image.Destroy();
+        }
+        mOutput.Destroy();
+    }
+
+    void OfflineRunner::DestroyDevice()
+    {
+        vkDestroyCommandPool(mContext.Device(), mCommandPool, nullptr);
+        vmaDestroyAllocator(mContext.Allocator);
+        mContext.Allocator = nullptr;
+        mDevice.Destroy();
+        mInstance.Destroy();
+    }
+}  // namespace foray::bmfr::offline
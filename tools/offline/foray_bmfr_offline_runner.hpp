@@ -0,0 +1,77 @@
+#pragma once
+#include "foray_bmfr_offline_sequence.hpp"
+#include <base/foray_vulkandevice.hpp>
+#include <base/foray_vulkaninstance.hpp>
+#include <foray_bmfr.hpp>
+
+namespace foray::bmfr::offline {
+    /// @brief Denoises a captured frame sequence headless, keeping temporal state across frames
+    /// @details Disk I/O (prefetch thread), host to staging copies into per slot buffers and write-back (writer thread) overlap with GPU work.
+    /// On the GPU, frames run one after another: the denoiser binds a single set of input images, so the upload copy of a frame waits until the
+    /// previous frame's denoise has finished reading them. InFlightFrames only lets the host prepare and submit ahead.
+    /// ComparePrecisions(...) instead replays a denoiser capture (CaptureWriter) to measure the regression scratch precisions against each other.
+    class OfflineRunner
+    {
+      public:
+        struct Options
+        {
+            std::string InputDir;
+            std::string OutputDir;
+            /// @brief Frames mapped ahead of the frame being uploaded
+            uint32_t PrefetchFrames = 4;
+            /// @brief Frames submitted to the device before waiting on the oldest. Their GPU work is serialized (see OfflineRunner)
+            uint32_t InFlightFrames = 2;
+        };
+
+        void Run(const Options& options);
+        /// @brief Replays the capture once per scratch precision (SCRATCH_*) and logs GPU time per frame and the output error against SCRATCH_FP32
+        void ComparePrecisions(const std::string& capturePath);
+
+      protected:
+        struct Slot
+        {
+            VkCommandBuffer CommandBuffer = nullptr;
+            VkFence         Fence         = nullptr;
+            VkBuffer        Staging       = nullptr;
+            VmaAllocation   StagingAlloc  = nullptr;
+            uint8_t*        StagingData   = nullptr;
+            VkBuffer        Readback      = nullptr;
+            VmaAllocation   ReadbackAlloc = nullptr;
+            uint8_t*        ReadbackData  = nullptr;
+            bool            Pending       = false;
+            uint32_t        FrameIdx      = 0;
+        };
+
+        void CreateDevice();
+        /// @brief Requests only what the denoiser needs, instead of foray's default ray tracing and presentation extensions
+        void ConfigurePhysicalDeviceSelector(vkb::PhysicalDeviceSelector& selector);
+        void CreateResources();
+        void DestroyResources();
+        void DestroyDevice();
+
+        void Upload(Slot& slot, const MappedFrame& frame);
+        void RecordAndSubmit(Slot& slot, const MappedFrame& frame, uint64_t frameNumber);
+        void Complete(Slot& slot, FrameWriter& writer);
+
+        /// @brief Replays one captured frame synchronously, reads the output back into slot.ReadbackData and returns its GPU time in milliseconds
+        fp64_t ReplayFrame(Slot& slot, CaptureReplayer& replayer, uint32_t index);
+
+        Options      mOptions;
+        SequenceInfo mInfo;
+        VkExtent2D   mExtent{};
+
+        core::Context        mContext;
+        base::VulkanInstance mInstance{&mContext};
+        base::VulkanDevice   mDevice{&mContext, [this](vkb::PhysicalDeviceSelector& selector) { ConfigurePhysicalDeviceSelector(selector); }};
+        VkQueue              mQueue            = nullptr;
+        uint32_t             mQueueFamilyIndex = 0;
+        VkCommandPool        mCommandPool      = nullptr;
+        VkQueryPool          mQueryPool        = nullptr;
+
+        core::ManagedImage mInputs[(size_t)EChannel::MaxEnum];
+        core::ManagedImage mOutput;
+
+        BmfrDenoiser      mDenoiser;
+        std::vector<Slot> mSlots;
+    };
+}  // namespace foray::bmfr::offline
@@ -0,0 +1,199 @@
+#include "foray_bmfr_offline_sequence.hpp"
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace foray::bmfr::offline {
+    SequenceInfo SequenceInfo::Load(const std::string& dir)
+    {
+        SequenceInfo  info;
+        std::ifstream file(dir + "/sequence.txt");
+        file >> info.Width >> info.Height >> info.FrameCount;
+        if(!file || info.Width == 0 || info.Height == 0)
+        {
+            throw std::runtime_error("Invalid or missing sequence.txt in " + dir);
+        }
+        return info;
+    }
+
+    const char* SequenceInfo::GetChannelName(EChannel channel)
+    {
+        const char* names[(size_t)EChannel::MaxEnum] = {"primary", "position", "normal", "albedo", "motion"};
+        return names[(size_t)channel];
+    }
+
+    size_t SequenceInfo::GetTexelSize(EChannel channel)
+    {
+        return channel == EChannel::Motion ? 2 * sizeof(uint16_t) : 4 * sizeof(uint16_t);
+    }
+
+    size_t SequenceInfo::GetChannelSize(EChannel channel) const
+    {
+        return (size_t)Width * Height * GetTexelSize(channel);
+    }
+
+    std::string SequenceInfo::GetFramePath(const std::string& dir, uint32_t frame, const char* suffix)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%06u.", frame);
+        return dir + "/" + name + suffix;
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) : mData(other.mData), mSize(other.mSize)
+    {
+        other.mData = nullptr;
+        other.mSize = 0;
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other)
+    {
+        Close();
+        mData       = other.mData;
+        mSize       = other.mSize;
+        other.mData = nullptr;
+        other.mSize = 0;
+        return *this;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+    void MappedFile::Open(const std::string& path, size_t expectedSize)
+    {
+        Close();
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+        {
+            throw std::runtime_error("Failed to open " + path);
+        }
+        struct stat fileStat{};
+        fstat(fd, &fileStat);
+        if((size_t)fileStat.st_size != expectedSize)
+        {
+            close(fd);
+            throw std::runtime_error("Unexpected size of " + path);
+        }
+        void* data = mmap(nullptr, expectedSize, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        close(fd);
+        if(data == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map " + path);
+        }
+        mData = (uint8_t*)data;
+        mSize = expectedSize;
+        madvise(mData, mSize, MADV_SEQUENTIAL);
+        madvise(mData, mSize, MADV_WILLNEED);
+
+        // MAP_POPULATE is only a hint for private mappings, touch every page so faults happen on this thread
+        volatile uint8_t sink     = 0;
+        long             pageSize = sysconf(_SC_PAGESIZE);
+        for(size_t offset = 0; offset < mSize; offset += (size_t)pageSize)
+        {
+            sink = sink + mData[offset];
+        }
+    }
+
+    void MappedFile::Close()
+    {
+        if(!!mData)
+        {
+            munmap(mData, mSize);
+            mData = nullptr;
+            mSize = 0;
+        }
+    }
+
+    FramePrefetcher::FramePrefetcher(const std::string& dir, const SequenceInfo& info, size_t capacity)
+        : mDir(dir), mInfo(info), mQueue(capacity), mThread(&FramePrefetcher::Run, this)
+    {
+    }
+
+    FramePrefetcher::~FramePrefetcher()
+    {
+        // Unblock the producer if the consumer stopped early
+        while(mQueue.Pop().has_value())
+        {
+        }
+        mThread.join();
+    }
+
+    std::optional<MappedFrame> FramePrefetcher::Next()
+    {
+        std::optional<MappedFrame> frame = mQueue.Pop();
+        if(!frame.has_value() && !!mError)
+        {  // Queue is closed, so the prefetch thread no longer writes mError
+            std::rethrow_exception(mError);
+        }
+        return frame;
+    }
+
+    void FramePrefetcher::Run()
+    {
+        try
+        {
+            for(uint32_t frameIdx = 0; frameIdx < mInfo.FrameCount; frameIdx++)
+            {
+                MappedFrame frame;
+                frame.Index = frameIdx;
+                frame.Cut   = std::filesystem::exists(SequenceInfo::GetFramePath(mDir, frameIdx, "cut"));
+                for(size_t channel = 0; channel < (size_t)EChannel::MaxEnum; channel++)
+                {
+                    std::string suffix = std::string(SequenceInfo::GetChannelName((EChannel)channel)) + ".raw";
+                    frame.Channels[channel].Open(SequenceInfo::GetFramePath(mDir, frameIdx, suffix.c_str()), mInfo.GetChannelSize((EChannel)channel));
+                }
+                mQueue.Push(std::move(frame));
+            }
+        }
+        catch(...)
+        {
+            mError = std::current_exception();
+        }
+        mQueue.Close();
+    }
+
+    FrameWriter::FrameWriter(const std::string& dir, size_t capacity) : mDir(dir), mQueue(capacity), mThread(&FrameWriter::Run, this) {}
+
+    FrameWriter::~FrameWriter()
+    {
+        mQueue.Close();
+        if(mThread.joinable())
+        {
+            mThread.join();
+        }
+    }
+
+    void FrameWriter::Finish()
+    {
+        mQueue.Close();
+        mThread.join();
+        if(!mFailedPath.empty())
+        {
+            throw std::runtime_error("Failed to write " + mFailedPath);
+        }
+    }
+
+    void FrameWriter::Write(uint32_t frame, std::vector<uint8_t>&& data)
+    {
+        mQueue.Push(Job{.Frame = frame, .Data = std::move(data)});
+    }
+
+    void FrameWriter::Run()
+    {
+        while(std::optional<Job> job = mQueue.Pop())
+        {
+            std::string   path = SequenceInfo::GetFramePath(mDir, job->Frame, "output.raw");
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write((const char*)job->Data.data(), (std::streamsize)job->Data.size());
+            if(!file && mFailedPath.empty())
+            {
+                mFailedPath = path;
+            }
+        }
+    }
+}  // namespace foray::bmfr::offline
@@ -0,0 +1,165 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace foray::bmfr::offline {
+    /// @brief Channels of a captured frame, in the formats the BMFR shaders bind them as
+    enum class EChannel
+    {
+        Primary,   // rgba16f
+        Position,  // rgba16f
+        Normal,    // rgba16f
+        Albedo,    // rgba16f
+        Motion,    // rg16f
+        MaxEnum
+    };
+
+    /// @brief Layout of a frame sequence on disk
+    /// @details
+    ///  <dir>/sequence.txt                 "<width> <height> <frameCount>"
+    ///  <dir>/<frame:06>.<channel>.raw     tightly packed rows in the channel's shader format (channel = primary, position, normal, albedo, motion)
+    ///  <dir>/<frame:06>.cut               optional, empty. History is discarded before this frame (camera cuts)
+    /// Output frames are written as <dir>/<frame:06>.output.raw (rgba16f)
+    struct SequenceInfo
+    {
+        uint32_t Width      = 0;
+        uint32_t Height     = 0;
+        uint32_t FrameCount = 0;
+
+        static SequenceInfo Load(const std::string& dir);
+
+        static const char* GetChannelName(EChannel channel);
+        static size_t      GetTexelSize(EChannel channel);
+        size_t             GetChannelSize(EChannel channel) const;
+        static std::string GetFramePath(const std::string& dir, uint32_t frame, const char* suffix);
+    };
+
+    /// @brief Read only memory mapping of a whole file
+    class MappedFile
+    {
+      public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other);
+        MappedFile& operator=(MappedFile&& other);
+        ~MappedFile();
+
+        /// @brief Maps the file and faults in its pages, so the consumer never blocks on disk I/O
+        void Open(const std::string& path, size_t expectedSize);
+        void Close();
+
+        inline const uint8_t* GetData() const { return mData; }
+        inline size_t         GetSize() const { return mSize; }
+
+      protected:
+        uint8_t* mData = nullptr;
+        size_t   mSize = 0;
+    };
+
+    struct MappedFrame
+    {
+        uint32_t   Index = 0;
+        bool       Cut   = false;
+        MappedFile Channels[(size_t)EChannel::MaxEnum];
+    };
+
+    /// @brief Single producer / single consumer queue with a fixed capacity
+    template <typename T>
+    class BoundedQueue
+    {
+      public:
+        explicit BoundedQueue(size_t capacity) : mCapacity(capacity) {}
+
+        void Push(T&& value)
+        {
+            std::unique_lock lock(mMutex);
+            mNotFull.wait(lock, [this] { return mQueue.size() < mCapacity; });
+            mQueue.push_back(std::move(value));
+            mNotEmpty.notify_one();
+        }
+        /// @brief Blocks until a value is available. Returns nullopt once closed and drained
+        std::optional<T> Pop()
+        {
+            std::unique_lock lock(mMutex);
+            mNotEmpty.wait(lock, [this] { return !mQueue.empty() || mClosed; });
+            if(mQueue.empty())
+            {
+                return std::nullopt;
+            }
+            T value = std::move(mQueue.front());
+            mQueue.pop_front();
+            mNotFull.notify_one();
+            return value;
+        }
+        void Close()
+        {
+            std::unique_lock lock(mMutex);
+            mClosed = true;
+            mNotEmpty.notify_all();
+        }
+
+      protected:
+        size_t                  mCapacity;
+        std::deque<T>           mQueue;
+        std::mutex              mMutex;
+        std::condition_variable mNotFull;
+        std::condition_variable mNotEmpty;
+        bool                    mClosed = false;
+    };
+
+    /// @brief Maps frames on a background thread, at most `capacity` frames ahead of the consumer
+    class FramePrefetcher
+    {
+      public:
+        FramePrefetcher(const std::string& dir, const SequenceInfo& info, size_t capacity);
+        ~FramePrefetcher();
+
+        /// @brief Returns nullopt after the last frame. Rethrows the error that stopped prefetching (missing or mis-sized file) once all frames
+        /// mapped before it have been consumed
+        std::optional<MappedFrame> Next();
+
+      protected:
+        void Run();
+
+        std::string               mDir;
+        SequenceInfo              mInfo;
+        BoundedQueue<MappedFrame> mQueue;
+        /// @brief Set by the prefetch thread before closing the queue
+        std::exception_ptr        mError;
+        std::thread               mThread;
+    };
+
+    /// @brief Writes output frames on a background thread
+    class FrameWriter
+    {
+      public:
+        FrameWriter(const std::string& dir, size_t capacity);
+        ~FrameWriter();
+
+        void Write(uint32_t frame, std::vector<uint8_t>&& data);
+        /// @brief Writes all queued frames and throws if any of them could not be written
+        void Finish();
+
+      protected:
+        struct Job
+        {
+            uint32_t             Frame;
+            std::vector<uint8_t> Data;
+        };
+
+        void Run();
+
+        std::string       mDir;
+        BoundedQueue<Job> mQueue;
+        /// @brief First failed output path, written by the writer thread
+        std::string       mFailedPath;
+        std::thread       mThread;
+    };
+}  // namespace foray::bmfr::offline
@@ -0,0 +1,67 @@
+#include "foray_bmfr_offline_runner.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+    using foray::bmfr::offline::OfflineRunner;
+
+    OfflineRunner::Options options;
+    const char*            comparePrecisionCapture = nullptr;
+    int                    positional              = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--compare-precision") == 0 && i + 1 < argc)
+        {
+            comparePrecisionCapture = argv[++i];
+        }
+        else if(std::strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc)
+        {
+            options.PrefetchFrames = (uint32_t)std::atoi(argv[++i]);
+        }
+        else if(std::strcmp(argv[i], "--inflight") == 0 && i + 1 < argc)
+        {
+            options.InFlightFrames = (uint32_t)std::atoi(argv[++i]);
+        }
+        else if(positional == 0)
+        {
+            options.InputDir = argv[i];
+            positional++;
+        }
+        else if(positional == 1)
+        {
+            options.OutputDir = argv[i];
+            positional++;
+        }
+    }
+    bool compare = !!comparePrecisionCapture;
+    bool valid   = compare ? positional == 0 : positional == 2 && options.PrefetchFrames > 0 && options.InFlightFrames > 0;
+    if(!valid)
+    {
+        std::fprintf(stderr,
+                     "Usage: %s <input dir> <output dir> [--prefetch <frames>] [--inflight <frames>]\n"
+                     "       %s --compare-precision <capture file>\n",
+                     argv[0], argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        OfflineRunner runner;
+        if(compare)
+        {
+            runner.ComparePrecisions(comparePrecisionCapture);
+        }
+        else
+        {
+            runner.Run(options);
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}